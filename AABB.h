@@ -31,7 +31,172 @@ For more information, please refer to <http://unlicense.org/>
 #ifndef _AABB_H_
 #define _AABB_H_
 
-template<typename T, typename ElementType, unsigned int DIMENSIONS, long MIN, long MAX>
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#if !defined(AABB_NO_SIMD) && defined(__AVX__)
+#include <immintrin.h>
+#define AABB_SIMD_AVX
+#define AABB_SIMD_SSE
+#elif !defined(AABB_NO_SIMD) && (defined(__SSE__) || defined(_M_X64))
+#include <xmmintrin.h>
+#define AABB_SIMD_SSE
+#endif
+
+// Batch kernels behind AABB::extendAll(), on DIMENSIONS interleaved coordinates per point.
+class AABBKernels
+{
+public:
+	template<typename ElementType>
+	static void minMax(const ElementType * coordinates, size_t count, unsigned int dimensions, ElementType * min, ElementType * max)
+	{
+		const size_t total = count * dimensions;
+		for (size_t i = 0; i < total; i += dimensions)
+		{
+			for (unsigned int dim = 0; dim < dimensions; dim++)
+			{
+				min[dim] = std::min(min[dim], coordinates[i + dim]);
+				max[dim] = std::max(max[dim], coordinates[i + dim]);
+			}
+		}
+	}
+
+#if defined(AABB_SIMD_SSE)
+	/*
+	 Floats are loaded a vector at a time regardless of where points start: with one min and
+	 one max accumulator per dimension, a block of DIMENSIONS vectors holds a whole number of
+	 points, so lane j of accumulator k always sees dimension (k * WIDTH + j) % DIMENSIONS.
+	 The new values go first in min/max_ps, which return the second operand for NaN, so NaN
+	 coordinates are skipped as std::min/std::max skip them in the scalar version.
+	 */
+	static void minMax(const float * coordinates, size_t count, unsigned int dimensions, float * min, float * max)
+	{
+		const size_t total = count * dimensions;
+		size_t i = 0;
+		if (dimensions <= MaxSimdDimensions)
+		{
+#if defined(AABB_SIMD_AVX)
+			const unsigned int width = 8;
+			__m256 minimum[MaxSimdDimensions];
+			__m256 maximum[MaxSimdDimensions];
+			for (unsigned int k = 0; k < dimensions; k++)
+			{
+				minimum[k] = _mm256_set1_ps(std::numeric_limits<float>::max());
+				maximum[k] = _mm256_set1_ps(std::numeric_limits<float>::lowest());
+			}
+			for (; i + width * dimensions <= total; i += width * dimensions)
+			{
+				for (unsigned int k = 0; k < dimensions; k++)
+				{
+					const __m256 values = _mm256_loadu_ps(coordinates + i + k * width);
+					minimum[k] = _mm256_min_ps(values, minimum[k]);
+					maximum[k] = _mm256_max_ps(values, maximum[k]);
+				}
+			}
+			alignas(32) float lanesMin[width];
+			alignas(32) float lanesMax[width];
+#else
+			const unsigned int width = 4;
+			__m128 minimum[MaxSimdDimensions];
+			__m128 maximum[MaxSimdDimensions];
+			for (unsigned int k = 0; k < dimensions; k++)
+			{
+				minimum[k] = _mm_set1_ps(std::numeric_limits<float>::max());
+				maximum[k] = _mm_set1_ps(std::numeric_limits<float>::lowest());
+			}
+			for (; i + width * dimensions <= total; i += width * dimensions)
+			{
+				for (unsigned int k = 0; k < dimensions; k++)
+				{
+					const __m128 values = _mm_loadu_ps(coordinates + i + k * width);
+					minimum[k] = _mm_min_ps(values, minimum[k]);
+					maximum[k] = _mm_max_ps(values, maximum[k]);
+				}
+			}
+			alignas(16) float lanesMin[width];
+			alignas(16) float lanesMax[width];
+#endif
+			for (unsigned int k = 0; k < dimensions; k++)
+			{
+#if defined(AABB_SIMD_AVX)
+				_mm256_store_ps(lanesMin, minimum[k]);
+				_mm256_store_ps(lanesMax, maximum[k]);
+#else
+				_mm_store_ps(lanesMin, minimum[k]);
+				_mm_store_ps(lanesMax, maximum[k]);
+#endif
+				for (unsigned int j = 0; j < width; j++)
+				{
+					const unsigned int dim = (k * width + j) % dimensions;
+					min[dim] = std::min(min[dim], lanesMin[j]);
+					max[dim] = std::max(max[dim], lanesMax[j]);
+				}
+			}
+		}
+
+		minMax<float>(coordinates + i, (total - i) / dimensions, dimensions, min, max);
+	}
+#endif
+
+	// minMax() split over threads, each reducing its own slice
+	template<typename ElementType>
+	static void parallelMinMax(const ElementType * coordinates, size_t count, unsigned int dimensions, ElementType * min, ElementType * max, unsigned int threads)
+	{
+		if (threads == 0)
+			threads = std::max(1u, std::thread::hardware_concurrency());
+		threads = (unsigned int)std::min<size_t>(threads, std::max<size_t>(1, count / MinPointsPerThread));
+		if (threads <= 1)
+		{
+			minMax(coordinates, count, dimensions, min, max);
+			return;
+		}
+
+		std::vector<ElementType> partial(size_t(threads) * dimensions * 2);
+		for (unsigned int t = 0; t < threads; t++)
+		{
+			for (unsigned int dim = 0; dim < dimensions; dim++)
+			{
+				partial[(t * 2) * dimensions + dim] = min[dim];
+				partial[(t * 2 + 1) * dimensions + dim] = max[dim];
+			}
+		}
+
+		std::vector<std::thread> pool;
+		const size_t slice = (count + threads - 1) / threads;
+		for (unsigned int t = 0; t < threads; t++)
+		{
+			const size_t first = std::min(count, t * slice);
+			const size_t last = std::min(count, first + slice);
+			ElementType * sliceMin = &partial[(t * 2) * dimensions];
+			ElementType * sliceMax = &partial[(t * 2 + 1) * dimensions];
+			pool.push_back(std::thread([=]()
+			{
+				minMax(coordinates + first * dimensions, last - first, dimensions, sliceMin, sliceMax);
+			}));
+		}
+
+		for (unsigned int t = 0; t < threads; t++)
+		{
+			pool[t].join();
+			for (unsigned int dim = 0; dim < dimensions; dim++)
+			{
+				min[dim] = std::min(min[dim], partial[(t * 2) * dimensions + dim]);
+				max[dim] = std::max(max[dim], partial[(t * 2 + 1) * dimensions + dim]);
+			}
+		}
+	}
+
+private:
+	static const unsigned int MaxSimdDimensions = 8;
+	static const size_t MinPointsPerThread = 1 << 16;
+};
+
+// MIN and MAX are no longer used; the default constructed box is empty for any ElementType.
+template<typename T, typename ElementType, unsigned int DIMENSIONS, long MIN = 0, long MAX = 0>
 class AABB
 {
 public:
@@ -39,8 +204,8 @@ public:
 	{
 		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
 		{
-			_min[dim] = ElementType(MAX);
-			_max[dim] = ElementType(MIN);
+			_min[dim] = std::numeric_limits<ElementType>::max();
+			_max[dim] = std::numeric_limits<ElementType>::lowest();
 		}
 
 	}
@@ -66,6 +231,82 @@ public:
 		}
 	}
 
+	void extend(const AABB & box)
+	{
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+		{
+			_min[dim] = std::min<ElementType>(box._min[dim], _min[dim]);
+			_max[dim] = std::max<ElementType>(box._max[dim], _max[dim]);
+		}
+	}
+
+	/*
+	 Extends the box by count points at once; threads = 0 uses every hardware thread, and small
+	 inputs stay on the calling thread. Points whose type is exactly DIMENSIONS packed
+	 ElementTypes (glm::vec3 and the like) are reduced with SIMD, others one by one.
+	 */
+	void extendAll(const T * points, size_t count, unsigned int threads = 1)
+	{
+		if (sizeof(T) == sizeof(ElementType) * DIMENSIONS && std::is_standard_layout<T>::value)
+			extendAllCoordinates(reinterpret_cast<const ElementType *>(points), count, threads);
+		else
+		{
+			for (size_t i = 0; i < count; i++)
+				extend(points[i]);
+		}
+	}
+
+	// the same for DIMENSIONS interleaved coordinates per point
+	void extendAllCoordinates(const ElementType * coordinates, size_t count, unsigned int threads = 1)
+	{
+		ElementType min[DIMENSIONS];
+		ElementType max[DIMENSIONS];
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+		{
+			min[dim] = _min[dim];
+			max[dim] = _max[dim];
+		}
+
+		AABBKernels::parallelMinMax(coordinates, count, DIMENSIONS, min, max, threads);
+
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+		{
+			_min[dim] = min[dim];
+			_max[dim] = max[dim];
+		}
+	}
+
+	// boxes that only touch overlap
+	bool overlaps(const AABB & box) const
+	{
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+		{
+			if (box._max[dim] < _min[dim] || box._min[dim] > _max[dim])
+				return false;
+		}
+		return true;
+	}
+
+	bool contains(const T & p) const
+	{
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+		{
+			if (p[dim] < _min[dim] || p[dim] > _max[dim])
+				return false;
+		}
+		return true;
+	}
+
+	bool contains(const AABB & box) const
+	{
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+		{
+			if (box._min[dim] < _min[dim] || box._max[dim] > _max[dim])
+				return false;
+		}
+		return true;
+	}
+
 	inline T getMin() const { return _min; }
 	inline T getMax() const { return _max; }
     inline T getSize() const { return (getMax() - getMin()); }
@@ -78,4 +319,181 @@ private:
 	T _max;
 };
 
-#endif
\ No newline at end of file
+/*
+ WIDTH float boxes in structure-of-arrays layout, for testing one box or ray against several
+ boxes in one go. WIDTH 4 uses SSE and WIDTH 8 uses AVX when the build enables them; any
+ other combination runs the same test lane by lane. Results are bit masks, bit i for lane i.
+ Lanes that were never set (or were cleared) never report a hit. Loads are unaligned, so
+ packets may live anywhere.
+ */
+template<unsigned int DIMENSIONS, int WIDTH>
+class AABBPacket
+{
+public:
+	alignas(32) float min[DIMENSIONS][WIDTH];
+	alignas(32) float max[DIMENSIONS][WIDTH];
+
+	AABBPacket()
+	{
+		clear();
+	}
+
+	void clear()
+	{
+		_lanes = 0;
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+		{
+			for (int lane = 0; lane < WIDTH; lane++)
+			{
+				min[dim][lane] = std::numeric_limits<float>::max();
+				max[dim][lane] = std::numeric_limits<float>::lowest();
+			}
+		}
+	}
+
+	void set(int lane, const float * boxMin, const float * boxMax)
+	{
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+		{
+			min[dim][lane] = boxMin[dim];
+			max[dim][lane] = boxMax[dim];
+		}
+		_lanes |= 1 << lane;
+	}
+
+	template<typename T, long MIN, long MAX>
+	void set(int lane, const AABB<T, float, DIMENSIONS, MIN, MAX> & box)
+	{
+		T boxMin;
+		T boxMax;
+		box.getMinMax(boxMin, boxMax);
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+		{
+			min[dim][lane] = boxMin[dim];
+			max[dim][lane] = boxMax[dim];
+		}
+		_lanes |= 1 << lane;
+	}
+
+	// lanes overlapping the box boxMin - boxMax; touching boxes overlap
+	int overlaps(const float * boxMin, const float * boxMax) const
+	{
+		return overlaps(boxMin, boxMax, std::integral_constant<int, WIDTH>()) & _lanes;
+	}
+
+	// Lanes hit by origin + t * direction for t in [0, maxDistance], with entry[lane] set to
+	// where the ray enters each box (0 if it starts inside). Pass 1 / direction, per dimension.
+	int intersectRay(const float * origin, const float * inverseDirection, float maxDistance, float * entry) const
+	{
+		return intersectRay(origin, inverseDirection, maxDistance, entry, std::integral_constant<int, WIDTH>()) & _lanes;
+	}
+
+private:
+	int _lanes;
+
+	template<int W>
+	int overlaps(const float * boxMin, const float * boxMax, std::integral_constant<int, W>) const
+	{
+		int mask = 0;
+		for (int lane = 0; lane < WIDTH; lane++)
+		{
+			bool overlap = true;
+			for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+				overlap = overlap && !(boxMax[dim] < min[dim][lane]) && !(boxMin[dim] > max[dim][lane]);
+			mask |= int(overlap) << lane;
+		}
+		return mask;
+	}
+
+	template<int W>
+	int intersectRay(const float * origin, const float * inverseDirection, float maxDistance, float * entry, std::integral_constant<int, W>) const
+	{
+		int mask = 0;
+		for (int lane = 0; lane < WIDTH; lane++)
+		{
+			float enter = 0.0f;
+			float exit = maxDistance;
+			for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+			{
+				const float t0 = (min[dim][lane] - origin[dim]) * inverseDirection[dim];
+				const float t1 = (max[dim][lane] - origin[dim]) * inverseDirection[dim];
+				enter = std::max(enter, std::min(t0, t1));
+				exit = std::min(exit, std::max(t0, t1));
+			}
+			entry[lane] = enter;
+			mask |= int(enter <= exit) << lane;
+		}
+		return mask;
+	}
+
+	// The SIMD versions order their min/max operands so NaN, from 0 * inf when the ray lies in a
+	// slab plane, is dropped just as std::min/std::max drop it above: min/max_ps return the
+	// second operand when either is NaN
+#if defined(AABB_SIMD_SSE)
+	int overlaps(const float * boxMin, const float * boxMax, std::integral_constant<int, 4>) const
+	{
+		__m128 outside = _mm_setzero_ps();
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+		{
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_set1_ps(boxMax[dim]), _mm_loadu_ps(min[dim])));
+			outside = _mm_or_ps(outside, _mm_cmpgt_ps(_mm_set1_ps(boxMin[dim]), _mm_loadu_ps(max[dim])));
+		}
+		return ~_mm_movemask_ps(outside) & 0xF;
+	}
+
+	int intersectRay(const float * origin, const float * inverseDirection, float maxDistance, float * entry, std::integral_constant<int, 4>) const
+	{
+		__m128 enter = _mm_setzero_ps();
+		__m128 exit = _mm_set1_ps(maxDistance);
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+		{
+			const __m128 start = _mm_set1_ps(origin[dim]);
+			const __m128 inverse = _mm_set1_ps(inverseDirection[dim]);
+			const __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(min[dim]), start), inverse);
+			const __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(max[dim]), start), inverse);
+			enter = _mm_max_ps(_mm_min_ps(t1, t0), enter);
+			exit = _mm_min_ps(_mm_max_ps(t1, t0), exit);
+		}
+		_mm_storeu_ps(entry, enter);
+		return _mm_movemask_ps(_mm_cmple_ps(enter, exit));
+	}
+#endif
+
+#if defined(AABB_SIMD_AVX)
+	int overlaps(const float * boxMin, const float * boxMax, std::integral_constant<int, 8>) const
+	{
+		__m256 outside = _mm256_setzero_ps();
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+		{
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_set1_ps(boxMax[dim]), _mm256_loadu_ps(min[dim]), _CMP_LT_OQ));
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_set1_ps(boxMin[dim]), _mm256_loadu_ps(max[dim]), _CMP_GT_OQ));
+		}
+		return ~_mm256_movemask_ps(outside) & 0xFF;
+	}
+
+	int intersectRay(const float * origin, const float * inverseDirection, float maxDistance, float * entry, std::integral_constant<int, 8>) const
+	{
+		__m256 enter = _mm256_setzero_ps();
+		__m256 exit = _mm256_set1_ps(maxDistance);
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+		{
+			const __m256 start = _mm256_set1_ps(origin[dim]);
+			const __m256 inverse = _mm256_set1_ps(inverseDirection[dim]);
+			const __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(min[dim]), start), inverse);
+			const __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(max[dim]), start), inverse);
+			enter = _mm256_max_ps(_mm256_min_ps(t1, t0), enter);
+			exit = _mm256_min_ps(_mm256_max_ps(t1, t0), exit);
+		}
+		_mm256_storeu_ps(entry, enter);
+		return _mm256_movemask_ps(_mm256_cmp_ps(enter, exit, _CMP_LE_OQ));
+	}
+#endif
+};
+
+template<unsigned int DIMENSIONS>
+using AABBPacket4 = AABBPacket<DIMENSIONS, 4>;
+
+template<unsigned int DIMENSIONS>
+using AABBPacket8 = AABBPacket<DIMENSIONS, 8>;
+
+#endif
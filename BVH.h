@@ -0,0 +1,600 @@
+#ifndef _BVH_H_
+#define _BVH_H_
+
+/*
+LICENSE - this file is public domain
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#include "AABB.h"
+
+/*
+ Static bounding volume hierarchy over a list of AABBs, for ray, segment, overlap and
+ closest object queries over objects with extent.
+
+ Built top-down with binned SAH (Wald, "On fast Construction of SAH-based Bounding Volume
+ Hierarchies", 2007): each split is the best of BVHBins candidate planes per axis, and a node
+ becomes a leaf when no split is cheaper than testing its objects. Subtrees above a few
+ thousand objects are built on separate threads.
+
+ Nodes are stored flat, the two children of a node next to each other, and are 32 bytes for
+ 3D float boxes. Queries walk the tree with a fixed stack of BVHMaxDepth entries, nearer
+ child first; the build never makes the tree deeper than that.
+ */
+
+static const int BVHBins = 16;
+static const int BVHMaxDepth = 64;
+
+template<typename T, typename ElementType, unsigned int DIMENSIONS>
+class BVH
+{
+public:
+	struct Node
+	{
+		ElementType min[DIMENSIONS];
+		ElementType max[DIMENSIONS];
+		// first child for interior nodes (the second is leftOrFirst + 1), first object for leaves
+		uint32_t leftOrFirst;
+		// objects in a leaf, 0 for interior nodes
+		uint32_t count;
+
+		bool isLeaf() const { return count > 0; }
+	};
+
+	BVH()
+		:_spawnDepth(0)
+	{
+	}
+
+	// threads = 0 uses every hardware thread. The boxes are copied.
+	template<long MIN, long MAX>
+	void build(const std::vector<AABB<T, ElementType, DIMENSIONS, MIN, MAX>> & boxes, unsigned int threads = 0)
+	{
+		_objectMin.resize(boxes.size() * DIMENSIONS);
+		_objectMax.resize(boxes.size() * DIMENSIONS);
+		for (size_t i = 0; i < boxes.size(); i++)
+		{
+			T min;
+			T max;
+			boxes[i].getMinMax(min, max);
+			for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+			{
+				_objectMin[i * DIMENSIONS + dim] = min[dim];
+				_objectMax[i * DIMENSIONS + dim] = max[dim];
+			}
+		}
+
+		_indices.resize(boxes.size());
+		for (size_t i = 0; i < boxes.size(); i++)
+			_indices[i] = uint32_t(i);
+
+		_nodes.clear();
+		if (boxes.empty())
+			return;
+
+		if (threads == 0)
+			threads = std::max(1u, std::thread::hardware_concurrency());
+
+		_spawnDepth = 0;
+		while ((1u << _spawnDepth) < threads)
+			_spawnDepth++;
+
+		_nodes.resize(boxes.size() * 2 - 1);
+		std::atomic<uint32_t> nodesUsed(1);
+		Node & root = _nodes[0];
+		root.leftOrFirst = 0;
+		root.count = uint32_t(boxes.size());
+		subdivide(0, 0, nodesUsed);
+		_nodes.resize(nodesUsed.load());
+	}
+
+	size_t objectCount() const { return _indices.size(); }
+	const std::vector<Node> & nodes() const { return _nodes; }
+
+	/*
+	 Calls hit(index, distance) for every object whose box the ray origin + t * direction
+	 enters for t in [0, maxDistance], where distance is the entry t. Visits nearer subtrees
+	 first. hit returns the new maxDistance: return distance (or an exact hit distance) to
+	 only look for closer objects, maxDistance to visit all, or a negative value to stop.
+	 */
+	template<typename Visitor>
+	void raycast(const T & origin, const T & direction, ElementType maxDistance, Visitor hit) const
+	{
+		if (_nodes.empty())
+			return;
+
+		Ray ray;
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+		{
+			ray.origin[dim] = origin[dim];
+			ray.inverse[dim] = ElementType(1) / direction[dim];
+		}
+
+		ElementType entry = 0;
+		if (!intersect(ray, _nodes[0].min, _nodes[0].max, maxDistance, entry))
+			return;
+
+		uint32_t stack[BVHMaxDepth];
+		ElementType stackEntry[BVHMaxDepth];
+		int top = 0;
+		uint32_t nodeIndex = 0;
+		for (;;)
+		{
+			const Node & node = _nodes[nodeIndex];
+			if (node.isLeaf())
+			{
+				for (uint32_t i = 0; i < node.count && maxDistance >= 0; i++)
+				{
+					const uint32_t object = _indices[node.leftOrFirst + i];
+					ElementType distance = 0;
+					if (intersect(ray, &_objectMin[object * DIMENSIONS], &_objectMax[object * DIMENSIONS], maxDistance, distance))
+						maxDistance = hit(object, distance);
+				}
+				if (maxDistance < 0)
+					return;
+			}
+			else
+			{
+				const uint32_t left = node.leftOrFirst;
+				ElementType leftEntry = 0;
+				ElementType rightEntry = 0;
+				const bool hitLeft = intersect(ray, _nodes[left].min, _nodes[left].max, maxDistance, leftEntry);
+				const bool hitRight = intersect(ray, _nodes[left + 1].min, _nodes[left + 1].max, maxDistance, rightEntry);
+				if (hitLeft && hitRight)
+				{
+					const bool leftFirst = leftEntry <= rightEntry;
+					stack[top] = leftFirst ? left + 1 : left;
+					stackEntry[top++] = leftFirst ? rightEntry : leftEntry;
+					nodeIndex = leftFirst ? left : left + 1;
+					continue;
+				}
+				if (hitLeft || hitRight)
+				{
+					nodeIndex = hitLeft ? left : left + 1;
+					continue;
+				}
+			}
+
+			// pop, skipping subtrees that start beyond a closer hit found since they were pushed
+			do
+			{
+				if (top == 0)
+					return;
+				top--;
+			} while (stackEntry[top] > maxDistance);
+			nodeIndex = stack[top];
+		}
+	}
+
+	// closest object box hit by the ray within maxDistance
+	bool raycastClosest(const T & origin, const T & direction, ElementType maxDistance, unsigned int & index, ElementType & distance) const
+	{
+		bool found = false;
+		raycast(origin, direction, maxDistance, [&](unsigned int object, ElementType entry) -> ElementType
+		{
+			found = true;
+			index = object;
+			distance = entry;
+			return entry;
+		});
+		return found;
+	}
+
+	// true if any object box touches the segment from -> to, for line of sight tests
+	bool segmentHitsAny(const T & from, const T & to) const
+	{
+		T direction = to;
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+			direction[dim] = to[dim] - from[dim];
+
+		bool found = false;
+		raycast(from, direction, ElementType(1), [&](unsigned int, ElementType) -> ElementType
+		{
+			found = true;
+			return ElementType(-1);
+		});
+		return found;
+	}
+
+	// appends the index of every object whose box overlaps box
+	template<long MIN, long MAX>
+	void overlapping(const AABB<T, ElementType, DIMENSIONS, MIN, MAX> & box, std::vector<unsigned int> & indices) const
+	{
+		if (_nodes.empty())
+			return;
+
+		T boxMin;
+		T boxMax;
+		box.getMinMax(boxMin, boxMax);
+		ElementType min[DIMENSIONS];
+		ElementType max[DIMENSIONS];
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+		{
+			min[dim] = boxMin[dim];
+			max[dim] = boxMax[dim];
+		}
+
+		uint32_t stack[BVHMaxDepth];
+		int top = 0;
+		uint32_t nodeIndex = 0;
+		if (!overlaps(_nodes[0].min, _nodes[0].max, min, max))
+			return;
+
+		for (;;)
+		{
+			const Node & node = _nodes[nodeIndex];
+			if (node.isLeaf())
+			{
+				for (uint32_t i = 0; i < node.count; i++)
+				{
+					const uint32_t object = _indices[node.leftOrFirst + i];
+					if (overlaps(&_objectMin[object * DIMENSIONS], &_objectMax[object * DIMENSIONS], min, max))
+						indices.push_back(object);
+				}
+			}
+			else
+			{
+				const uint32_t left = node.leftOrFirst;
+				const bool hitLeft = overlaps(_nodes[left].min, _nodes[left].max, min, max);
+				const bool hitRight = overlaps(_nodes[left + 1].min, _nodes[left + 1].max, min, max);
+				if (hitLeft && hitRight)
+					stack[top++] = left + 1;
+				if (hitLeft || hitRight)
+				{
+					nodeIndex = hitLeft ? left : left + 1;
+					continue;
+				}
+			}
+
+			if (top == 0)
+				return;
+			nodeIndex = stack[--top];
+		}
+	}
+
+	// object whose box is closest to point (distance 0 if inside)
+	bool closest(const T & point, unsigned int & index, ElementType & distance) const
+	{
+		return closest(point, index, distance, [&](unsigned int object) -> ElementType
+		{
+			return std::sqrt(boxDistance2(point, &_objectMin[object * DIMENSIONS], &_objectMax[object * DIMENSIONS]));
+		});
+	}
+
+	// Closest object by objectDistance(index), which must never be less than the distance to
+	// the object's box; boxes are used to skip objects that cannot be closer.
+	template<typename Distance>
+	bool closest(const T & point, unsigned int & index, ElementType & distance, Distance objectDistance) const
+	{
+		if (_nodes.empty())
+			return false;
+
+		bool found = false;
+		ElementType best = std::numeric_limits<ElementType>::max();
+		ElementType best2 = best;
+		uint32_t stack[BVHMaxDepth];
+		ElementType stackDistance2[BVHMaxDepth];
+		int top = 0;
+		uint32_t nodeIndex = 0;
+		for (;;)
+		{
+			const Node & node = _nodes[nodeIndex];
+			if (node.isLeaf())
+			{
+				for (uint32_t i = 0; i < node.count; i++)
+				{
+					const uint32_t object = _indices[node.leftOrFirst + i];
+					if (boxDistance2(point, &_objectMin[object * DIMENSIONS], &_objectMax[object * DIMENSIONS]) >= best2)
+						continue;
+
+					const ElementType candidate = objectDistance(object);
+					if (candidate < best)
+					{
+						found = true;
+						best = candidate;
+						best2 = candidate * candidate;
+						index = object;
+					}
+				}
+			}
+			else
+			{
+				const uint32_t left = node.leftOrFirst;
+				const ElementType leftDistance2 = boxDistance2(point, _nodes[left].min, _nodes[left].max);
+				const ElementType rightDistance2 = boxDistance2(point, _nodes[left + 1].min, _nodes[left + 1].max);
+				const bool leftFirst = leftDistance2 <= rightDistance2;
+				const ElementType nearDistance2 = leftFirst ? leftDistance2 : rightDistance2;
+				const ElementType farDistance2 = leftFirst ? rightDistance2 : leftDistance2;
+				if (farDistance2 < best2)
+				{
+					stack[top] = leftFirst ? left + 1 : left;
+					stackDistance2[top++] = farDistance2;
+				}
+				if (nearDistance2 < best2)
+				{
+					nodeIndex = leftFirst ? left : left + 1;
+					continue;
+				}
+			}
+
+			do
+			{
+				if (top == 0)
+				{
+					if (found)
+						distance = best;
+					return found;
+				}
+				top--;
+			} while (stackDistance2[top] >= best2);
+			nodeIndex = stack[top];
+		}
+	}
+
+private:
+	struct Ray
+	{
+		ElementType origin[DIMENSIONS];
+		ElementType inverse[DIMENSIONS];
+	};
+
+	struct Bin
+	{
+		ElementType min[DIMENSIONS];
+		ElementType max[DIMENSIONS];
+		uint32_t count;
+	};
+
+	// object bounds, DIMENSIONS values per object
+	std::vector<ElementType> _objectMin;
+	std::vector<ElementType> _objectMax;
+	// leaves reference ranges of this permutation of the objects
+	std::vector<uint32_t> _indices;
+	std::vector<Node> _nodes;
+	int _spawnDepth;
+
+	// below this many objects a subtree is built on the thread that reached it
+	static const uint32_t ParallelThreshold = 4096;
+
+	// nodesUsed hands out child pairs, shared by all build threads
+	void subdivide(uint32_t nodeIndex, int depth, std::atomic<uint32_t> & nodesUsed)
+	{
+		Node & node = _nodes[nodeIndex];
+		const uint32_t first = node.leftOrFirst;
+		const uint32_t count = node.count;
+
+		ElementType centroidMin[DIMENSIONS];
+		ElementType centroidMax[DIMENSIONS];
+		empty(node.min, node.max);
+		empty(centroidMin, centroidMax);
+		for (uint32_t i = first; i < first + count; i++)
+		{
+			const uint32_t object = _indices[i];
+			extend(node.min, node.max, &_objectMin[object * DIMENSIONS], &_objectMax[object * DIMENSIONS]);
+			for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+			{
+				const ElementType centre = centroid(object, dim);
+				centroidMin[dim] = std::min(centroidMin[dim], centre);
+				centroidMax[dim] = std::max(centroidMax[dim], centre);
+			}
+		}
+
+		if (count <= 1 || depth >= BVHMaxDepth - 1)
+			return;
+
+		// best binned split over all axes, compared with the cost of making this a leaf
+		int bestAxis = -1;
+		int bestPlane = 0;
+		ElementType bestCost = ElementType(count) * area(node.min, node.max);
+		for (unsigned int axis = 0; axis < DIMENSIONS; axis++)
+		{
+			const ElementType extent = centroidMax[axis] - centroidMin[axis];
+			if (!(extent > 0))
+				continue;
+
+			Bin bins[BVHBins];
+			for (int b = 0; b < BVHBins; b++)
+			{
+				empty(bins[b].min, bins[b].max);
+				bins[b].count = 0;
+			}
+
+			const ElementType scale = ElementType(BVHBins) / extent;
+			for (uint32_t i = first; i < first + count; i++)
+			{
+				const uint32_t object = _indices[i];
+				Bin & bin = bins[binIndex(centroid(object, axis), centroidMin[axis], scale)];
+				extend(bin.min, bin.max, &_objectMin[object * DIMENSIONS], &_objectMax[object * DIMENSIONS]);
+				bin.count++;
+			}
+
+			// sweep from the right to get the right side of every plane, then from the left
+			ElementType rightArea[BVHBins - 1];
+			uint32_t rightCount[BVHBins - 1];
+			ElementType min[DIMENSIONS];
+			ElementType max[DIMENSIONS];
+			empty(min, max);
+			uint32_t sum = 0;
+			for (int plane = BVHBins - 1; plane > 0; plane--)
+			{
+				if (bins[plane].count > 0)
+					extend(min, max, bins[plane].min, bins[plane].max);
+				sum += bins[plane].count;
+				rightArea[plane - 1] = sum > 0 ? area(min, max) : ElementType(0);
+				rightCount[plane - 1] = sum;
+			}
+
+			empty(min, max);
+			sum = 0;
+			for (int plane = 0; plane < BVHBins - 1; plane++)
+			{
+				if (bins[plane].count > 0)
+					extend(min, max, bins[plane].min, bins[plane].max);
+				sum += bins[plane].count;
+				if (sum == 0 || rightCount[plane] == 0)
+					continue;
+
+				const ElementType cost = ElementType(sum) * area(min, max) + ElementType(rightCount[plane]) * rightArea[plane];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = int(axis);
+					bestPlane = plane;
+				}
+			}
+		}
+
+		if (bestAxis < 0)
+			return;
+
+		const ElementType scale = ElementType(BVHBins) / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+		uint32_t * middle = std::partition(&_indices[first], &_indices[first] + count, [&](uint32_t object)
+		{
+			return binIndex(centroid(object, bestAxis), centroidMin[bestAxis], scale) <= bestPlane;
+		});
+		const uint32_t leftCount = uint32_t(middle - &_indices[first]);
+
+		const uint32_t left = nodesUsed.fetch_add(2);
+		_nodes[left].leftOrFirst = first;
+		_nodes[left].count = leftCount;
+		_nodes[left + 1].leftOrFirst = first + leftCount;
+		_nodes[left + 1].count = count - leftCount;
+		node.leftOrFirst = left;
+		node.count = 0;
+
+		if (depth < _spawnDepth && count >= ParallelThreshold)
+		{
+			std::thread leftThread(&BVH::subdivide, this, left, depth + 1, std::ref(nodesUsed));
+			subdivide(left + 1, depth + 1, nodesUsed);
+			leftThread.join();
+		}
+		else
+		{
+			subdivide(left, depth + 1, nodesUsed);
+			subdivide(left + 1, depth + 1, nodesUsed);
+		}
+	}
+
+	inline ElementType centroid(uint32_t object, unsigned int dim) const
+	{
+		return (_objectMin[object * DIMENSIONS + dim] + _objectMax[object * DIMENSIONS + dim]) * ElementType(0.5);
+	}
+
+	static inline int binIndex(ElementType value, ElementType min, ElementType scale)
+	{
+		return std::min(BVHBins - 1, int((value - min) * scale));
+	}
+
+	static inline void empty(ElementType * min, ElementType * max)
+	{
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+		{
+			min[dim] = std::numeric_limits<ElementType>::max();
+			max[dim] = std::numeric_limits<ElementType>::lowest();
+		}
+	}
+
+	static inline void extend(ElementType * min, ElementType * max, const ElementType * otherMin, const ElementType * otherMax)
+	{
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+		{
+			min[dim] = std::min(min[dim], otherMin[dim]);
+			max[dim] = std::max(max[dim], otherMax[dim]);
+		}
+	}
+
+	// half the surface area in 3D, half the perimeter in 2D
+	static inline ElementType area(const ElementType * min, const ElementType * max)
+	{
+		if (DIMENSIONS == 1)
+			return ElementType(1);
+
+		ElementType sum = 0;
+		for (unsigned int skip = 0; skip < DIMENSIONS; skip++)
+		{
+			ElementType product = 1;
+			for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+			{
+				if (dim != skip)
+					product *= max[dim] - min[dim];
+			}
+			sum += product;
+		}
+		return sum;
+	}
+
+	static inline bool overlaps(const ElementType * min, const ElementType * max, const ElementType * otherMin, const ElementType * otherMax)
+	{
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+		{
+			if (otherMax[dim] < min[dim] || otherMin[dim] > max[dim])
+				return false;
+		}
+		return true;
+	}
+
+	// slab test; entry is where the ray enters the box, clamped to 0
+	static inline bool intersect(const Ray & ray, const ElementType * min, const ElementType * max, ElementType maxDistance, ElementType & entry)
+	{
+		ElementType enter = 0;
+		ElementType exit = maxDistance;
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+		{
+			const ElementType t0 = (min[dim] - ray.origin[dim]) * ray.inverse[dim];
+			const ElementType t1 = (max[dim] - ray.origin[dim]) * ray.inverse[dim];
+			enter = std::max(enter, std::min(t0, t1));
+			exit = std::min(exit, std::max(t0, t1));
+		}
+		entry = enter;
+		return enter <= exit;
+	}
+
+	static inline ElementType boxDistance2(const T & point, const ElementType * min, const ElementType * max)
+	{
+		ElementType sum = 0;
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+		{
+			const ElementType below = min[dim] - point[dim];
+			const ElementType above = point[dim] - max[dim];
+			const ElementType outside = std::max(ElementType(0), std::max(below, above));
+			sum += outside * outside;
+		}
+		return sum;
+	}
+};
+
+#endif
@@ -2,6 +2,8 @@
 #define _CIRCULAR_ARRAY_H_
 
 #include <string.h>
+#include <math.h>
+#include <algorithm>
 
 /*
 LICENSE - this file is public domain
@@ -41,11 +43,17 @@ public:
     T average() const;
     T addValue(T frameTime);
     T sum() const { return _sum; }
+    // number of values in the window, SIZE once it has filled up
+    int count() const { return _count; }
+    bool isFull() const { return _count == SIZE; }
+    // the value the next addValue() will overwrite once the window is full
+    T oldest() const { return _values[_index]; }
 
 private:
     T _sum;
     T _values[SIZE];
     int _index;
+    int _count;
     
 public:
     
@@ -56,6 +64,7 @@ template<int SIZE, typename T>
 CircularArray<SIZE, T>::CircularArray()
 :_sum(0)
 ,_index(0)
+,_count(0)
 {
     memset(&_values[0], 0, sizeof(_values));
 }
@@ -63,7 +72,10 @@ CircularArray<SIZE, T>::CircularArray()
 template<int SIZE, typename T>
 T CircularArray<SIZE, T>::average() const
 {
-    return sum() / (T)SIZE;
+    if(_count == 0)
+        return T(0);
+    
+    return sum() / (T)_count;
 }
 
 template<int SIZE, typename T>
@@ -75,9 +87,177 @@ T CircularArray<SIZE, T>::addValue(T newValue)
     _values[index] = newValue;
     _index++;
     _index = _index % SIZE;
+    if(_count < SIZE)
+        _count++;
+
+    return average();
+}
+
+
+// Rolling statistics over the last SIZE values. Everything is updated incrementally in
+// addValue(): min/max through monotonic queues, mean and variance through Welford's
+// update with removal, and percentiles through a BINS-bucket histogram over
+// [histogramMin, histogramMax] (values outside the range are counted in the end buckets).
+template<int SIZE, typename T, int BINS = 64>
+class WindowedStatistics
+{
+public:
+    WindowedStatistics(T histogramMin, T histogramMax);
+    T addValue(T value);
+    
+    int count() const { return _window.count(); }
+    T sum() const { return _window.sum(); }
+    T average() const { return count() > 0 ? T(_mean) : T(0); }
+    T min() const { return _minimum.front(); }
+    T max() const { return _maximum.front(); }
+    T variance() const;
+    T standardDeviation() const { return T(sqrt(double(variance()))); }
+    // fraction in [0,1], e.g. 0.99 for the 99th percentile. Accurate to within one histogram bucket.
+    T percentile(double fraction) const;
+    
+private:
+    // keeps the extreme value of the window at the front. Better(a, b) is true when a should evict b.
+    template<typename Better>
+    class MonotonicQueue
+    {
+    public:
+        MonotonicQueue() :_head(0), _count(0) {}
+        
+        void push(long long sequence, T value)
+        {
+            while(_count > 0 && !_better(back(), value))
+                _count--;
+            
+            const int slot = (_head + _count) % SIZE;
+            _values[slot] = value;
+            _sequences[slot] = sequence;
+            _count++;
+        }
+        
+        // drops the front if it was added at or before sequence
+        void expire(long long sequence)
+        {
+            if(_count > 0 && _sequences[_head] <= sequence)
+            {
+                _head = (_head + 1) % SIZE;
+                _count--;
+            }
+        }
+        
+        T front() const { return _count > 0 ? _values[_head] : T(0); }
+        
+    private:
+        T _values[SIZE];
+        long long _sequences[SIZE];
+        int _head;
+        int _count;
+        Better _better;
+        
+        T back() const { return _values[(_head + _count - 1) % SIZE]; }
+    };
+    
+    struct Less { bool operator()(T a, T b) const { return a < b; } };
+    struct Greater { bool operator()(T a, T b) const { return a > b; } };
+    
+    CircularArray<SIZE, T> _window;
+    MonotonicQueue<Less> _minimum;
+    MonotonicQueue<Greater> _maximum;
+    long long _sequence;
+    
+    double _mean;
+    double _m2;
+    
+    const double _histogramMin;
+    const double _binWidth;
+    int _bins[BINS];
+    
+    int binOf(T value) const;
+};
 
+template<int SIZE, typename T, int BINS>
+WindowedStatistics<SIZE, T, BINS>::WindowedStatistics(T histogramMin, T histogramMax)
+:_sequence(0)
+,_mean(0)
+,_m2(0)
+,_histogramMin(double(histogramMin))
+,_binWidth((double(histogramMax) - double(histogramMin)) / BINS)
+{
+    memset(&_bins[0], 0, sizeof(_bins));
+}
+
+template<int SIZE, typename T, int BINS>
+int WindowedStatistics<SIZE, T, BINS>::binOf(T value) const
+{
+    const double position = _binWidth > 0 ? (double(value) - _histogramMin) / _binWidth : 0;
+    if(position <= 0)
+        return 0;
+    if(position >= BINS - 1)
+        return BINS - 1;
+    return int(position);
+}
+
+template<int SIZE, typename T, int BINS>
+T WindowedStatistics<SIZE, T, BINS>::addValue(T value)
+{
+    if(_window.isFull())
+    {
+        const T evicted = _window.oldest();
+        const double n = double(_window.count() - 1);
+        const double delta = double(evicted) - _mean;
+        _mean = n > 0 ? _mean - delta / n : 0;
+        _m2 = n > 0 ? _m2 - delta * (double(evicted) - _mean) : 0;
+        _bins[binOf(evicted)]--;
+    }
+    
+    _window.addValue(value);
+    
+    const double n = double(_window.count());
+    const double delta = double(value) - _mean;
+    _mean += delta / n;
+    _m2 += delta * (double(value) - _mean);
+    if(_m2 < 0)
+        _m2 = 0;
+    _bins[binOf(value)]++;
+    
+    _minimum.expire(_sequence - SIZE);
+    _maximum.expire(_sequence - SIZE);
+    _minimum.push(_sequence, value);
+    _maximum.push(_sequence, value);
+    _sequence++;
+    
     return average();
 }
 
+template<int SIZE, typename T, int BINS>
+T WindowedStatistics<SIZE, T, BINS>::variance() const
+{
+    const int n = count();
+    return n > 1 ? T(_m2 / double(n - 1)) : T(0);
+}
+
+template<int SIZE, typename T, int BINS>
+T WindowedStatistics<SIZE, T, BINS>::percentile(double fraction) const
+{
+    const int n = count();
+    if(n == 0)
+        return T(0);
+    
+    const double rank = fraction * double(n);
+    double seen = 0;
+    for(int bin = 0 ; bin < BINS ; bin++)
+    {
+        if(_bins[bin] == 0)
+            continue;
+        
+        if(seen + _bins[bin] >= rank)
+        {
+            const double inside = (rank - seen) / double(_bins[bin]);
+            const double estimate = _histogramMin + (double(bin) + inside) * _binWidth;
+            return T(std::min(std::max(estimate, double(min())), double(max())));
+        }
+        seen += _bins[bin];
+    }
+    return max();
+}
 
 #endif
@@ -0,0 +1,342 @@
+#ifndef _COLORIZER_H_
+#define _COLORIZER_H_
+
+/*
+LICENSE - this file is public domain
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Palette.h"
+
+#if !defined(COLORIZER_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#include <emmintrin.h>
+#define COLORIZER_SIMD_SSE2
+#endif
+
+enum class ColorizerRange
+{
+	EXPLICIT,		// the range given to setRange()
+	AUTO,			// the range of the field itself, found in an extra pass before colouring
+	PREVIOUS_FRAME,	// the range seen by the previous call, found while colouring. The first call uses AUTO
+};
+
+/*
+ Turns a float scalar field into packed RGBA8 pixels (bytes R, G, B, A) in one pass over memory.
+ The palette, the sRGB encoding and the quantisation are baked into a table of packed pixels,
+ so per pixel all that is left is normalising the value into a table index and copying four
+ bytes. Rows are split into bands that the threads take in turn, and each row is handled in
+ blocks of BlockSize values, normalised and min/max tracked with SSE2 unless COLORIZER_NO_SIMD
+ is defined.
+
+ NaN values get the colour of the low end of the range and are ignored when finding the range.
+ */
+class Colorizer
+{
+public:
+	static const size_t BlockSize = 256;
+	static const size_t PixelsPerBand = 1 << 16;
+
+	// palette as for Palette::inigoQuilez(). Alpha is 255 for three channels, and never sRGB
+	// encoded for four. Leave encodeSRGB off when the palette is already authored in sRGB.
+	// Pixels take the nearest table entry; the default 64 KB table stays within 2 of the exact
+	// byte even where sRGB is steepest, close to black
+	Colorizer(const float palette[4][3], bool encodeSRGB = true, unsigned int resolution = 16384)
+	{
+		bake<3>(palette, encodeSRGB, resolution);
+	}
+
+	Colorizer(const float palette[4][4], bool encodeSRGB = true, unsigned int resolution = 16384)
+	{
+		bake<4>(palette, encodeSRGB, resolution);
+	}
+
+	void setRange(float min, float max)
+	{
+		_mode = ColorizerRange::EXPLICIT;
+		_min = min;
+		_max = max;
+	}
+
+	void setRangeMode(ColorizerRange mode) { _mode = mode; }
+	ColorizerRange rangeMode() const { return _mode; }
+
+	// the range used by the last colorize() call, and the range of the values it saw
+	float rangeMin() const { return _min; }
+	float rangeMax() const { return _max; }
+	float observedMin() const { return _observedMin; }
+	float observedMax() const { return _observedMax; }
+
+	void colorize(const float * field, size_t width, size_t height, uint8_t * rgba, unsigned int threads = 0)
+	{
+		colorize(field, width, height, width, rgba, width * 4, threads);
+	}
+
+	// fieldStride is in floats, rgbaStride in bytes. threads = 0 uses every hardware thread
+	void colorize(const float * field, size_t width, size_t height, size_t fieldStride, uint8_t * rgba, size_t rgbaStride, unsigned int threads = 0)
+	{
+		if (width == 0 || height == 0)
+			return;
+
+		if (_mode == ColorizerRange::AUTO || (_mode == ColorizerRange::PREVIOUS_FRAME && !_hasObserved))
+			findRange(field, width, height, fieldStride, _min, _max, threads);
+		else if (_mode == ColorizerRange::PREVIOUS_FRAME)
+		{
+			_min = _observedMin;
+			_max = _observedMax;
+		}
+
+		const float min = _min;
+		const float top = float(_packed.size() - 2);
+		const float scale = _max > _min ? top / (_max - _min) : 0.0f;
+		const uint32_t * packed = &_packed[0];
+
+		std::vector<float> bandMin, bandMax;
+		forEachBand(width, height, threads, bandMin, bandMax, [&](size_t row, float & rowMin, float & rowMax)
+		{
+			const float * source = field + row * fieldStride;
+			uint8_t * target = rgba + row * rgbaStride;
+			uint32_t index[BlockSize];
+			for (size_t first = 0; first < width; first += BlockSize)
+			{
+				const size_t count = width - first < BlockSize ? width - first : BlockSize;
+				indexBlock(source + first, count, min, scale, top, index, rowMin, rowMax);
+
+				for (size_t i = 0; i < count; i++)
+					std::memcpy(target + (first + i) * 4, packed + index[i], 4);
+			}
+		});
+
+		mergeBands(bandMin, bandMax, _observedMin, _observedMax);
+		_hasObserved = true;
+	}
+
+	// the min and max of the field, ignoring NaN. Both are NaN when every value is
+	static void findRange(const float * field, size_t width, size_t height, size_t fieldStride, float & min, float & max, unsigned int threads = 0)
+	{
+		std::vector<float> bandMin, bandMax;
+		forEachBand(width, height, threads, bandMin, bandMax, [&](size_t row, float & rowMin, float & rowMax)
+		{
+			const float * source = field + row * fieldStride;
+			minMaxBlock(source, width, rowMin, rowMax);
+		});
+		mergeBands(bandMin, bandMax, min, max);
+	}
+
+	// Writes an image as a PAM (netpbm P7, RGB_ALPHA) file, or with raw = true as just the
+	// rows of pixels. Stream is an SDL_FileStream, or anything with write(size_t bytes, const void * data)
+	template<typename Stream>
+	static bool write(Stream & stream, const uint8_t * rgba, size_t width, size_t height, size_t rgbaStride = 0, bool raw = false)
+	{
+		if (rgbaStride == 0)
+			rgbaStride = width * 4;
+
+		if (!raw)
+		{
+			const std::string header = "P7\nWIDTH " + std::to_string(width) + "\nHEIGHT " + std::to_string(height) +
+				"\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n";
+			if (stream.write(header.size(), header.data()) != header.size())
+				return false;
+		}
+
+		if (rgbaStride == width * 4)
+			return stream.write(width * height * 4, rgba) == width * height * 4;
+
+		for (size_t row = 0; row < height; row++)
+			if (stream.write(width * 4, rgba + row * rgbaStride) != width * 4)
+				return false;
+		return true;
+	}
+
+	static float encodeSRGB(float linear)
+	{
+		if (linear <= 0.0031308f)
+			return 12.92f * linear;
+		return 1.055f * std::pow(linear, 1.0f / 2.4f) - 0.055f;
+	}
+
+	// the baked table, resolution entries plus a copy of the last
+	const std::vector<uint32_t> & table() const { return _packed; }
+
+private:
+	std::vector<uint32_t> _packed;
+	ColorizerRange _mode = ColorizerRange::AUTO;
+	float _min = 0.0f;
+	float _max = 1.0f;
+	float _observedMin = 0.0f;
+	float _observedMax = 1.0f;
+	bool _hasObserved = false;
+
+	template<unsigned int DIMENSIONS>
+	void bake(const float palette[4][DIMENSIONS], bool encodeSRGB, unsigned int resolution)
+	{
+		PaletteTable<float, DIMENSIONS> table;
+		table.bake([palette, encodeSRGB](float t, float result[DIMENSIONS])
+		{
+			Palette::inigoQuilez<float, DIMENSIONS>(t, palette, result);
+			for (unsigned int i = 0; i < 3 && encodeSRGB; i++)
+				result[i] = Colorizer::encodeSRGB(std::min(std::max(result[i], 0.0f), 1.0f));
+		}, resolution);
+
+		// the byte table is RGBA8 for both three and four channels
+		const std::vector<uint8_t> & bytes = table.bytes();
+		_packed.resize(bytes.size() / 4);
+		std::memcpy(&_packed[0], &bytes[0], bytes.size());
+	}
+
+	// min and max ignore NaN, and the clamps are ordered so NaN ends up at index 0. _mm_min_ps
+	// and _mm_max_ps return their second operand when either is NaN, as the scalar code does
+	static inline void indexBlock(const float * source, size_t count, float min, float scale, float top, uint32_t * index, float & blockMin, float & blockMax)
+	{
+		float low = blockMin, high = blockMax;
+		size_t i = 0;
+#if defined(COLORIZER_SIMD_SSE2)
+		__m128 low4 = _mm_set1_ps(low), high4 = _mm_set1_ps(high);
+		const __m128 min4 = _mm_set1_ps(min), scale4 = _mm_set1_ps(scale), top4 = _mm_set1_ps(top);
+		const __m128 zero4 = _mm_setzero_ps(), half4 = _mm_set1_ps(0.5f);
+		for (; i + 4 <= count; i += 4)
+		{
+			const __m128 value = _mm_loadu_ps(source + i);
+			low4 = _mm_min_ps(value, low4);
+			high4 = _mm_max_ps(value, high4);
+
+			__m128 position = _mm_mul_ps(_mm_sub_ps(value, min4), scale4);
+			position = _mm_min_ps(_mm_max_ps(position, zero4), top4);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(index + i), _mm_cvttps_epi32(_mm_add_ps(position, half4)));
+		}
+		reduce(low4, high4, low, high);
+#endif
+		for (; i < count; i++)
+		{
+			const float value = source[i];
+			low = value < low ? value : low;
+			high = value > high ? value : high;
+
+			float position = (value - min) * scale;
+			position = position > 0.0f ? position : 0.0f;
+			position = position < top ? position : top;
+			index[i] = uint32_t(int32_t(position + 0.5f));
+		}
+		blockMin = low;
+		blockMax = high;
+	}
+
+	static inline void minMaxBlock(const float * source, size_t count, float & blockMin, float & blockMax)
+	{
+		float low = blockMin, high = blockMax;
+		size_t i = 0;
+#if defined(COLORIZER_SIMD_SSE2)
+		__m128 low4 = _mm_set1_ps(low), high4 = _mm_set1_ps(high);
+		for (; i + 4 <= count; i += 4)
+		{
+			const __m128 value = _mm_loadu_ps(source + i);
+			low4 = _mm_min_ps(value, low4);
+			high4 = _mm_max_ps(value, high4);
+		}
+		reduce(low4, high4, low, high);
+#endif
+		for (; i < count; i++)
+		{
+			low = source[i] < low ? source[i] : low;
+			high = source[i] > high ? source[i] : high;
+		}
+		blockMin = low;
+		blockMax = high;
+	}
+
+#if defined(COLORIZER_SIMD_SSE2)
+	static inline void reduce(__m128 low4, __m128 high4, float & low, float & high)
+	{
+		low4 = _mm_min_ps(low4, _mm_shuffle_ps(low4, low4, _MM_SHUFFLE(1, 0, 3, 2)));
+		low4 = _mm_min_ps(low4, _mm_shuffle_ps(low4, low4, _MM_SHUFFLE(2, 3, 0, 1)));
+		high4 = _mm_max_ps(high4, _mm_shuffle_ps(high4, high4, _MM_SHUFFLE(1, 0, 3, 2)));
+		high4 = _mm_max_ps(high4, _mm_shuffle_ps(high4, high4, _MM_SHUFFLE(2, 3, 0, 1)));
+		low = _mm_cvtss_f32(low4);
+		high = _mm_cvtss_f32(high4);
+	}
+#endif
+
+	static void mergeBands(const std::vector<float> & bandMin, const std::vector<float> & bandMax, float & min, float & max)
+	{
+		min = std::numeric_limits<float>::infinity();
+		max = -std::numeric_limits<float>::infinity();
+		for (size_t band = 0; band < bandMin.size(); band++)
+		{
+			min = std::min(min, bandMin[band]);
+			max = std::max(max, bandMax[band]);
+		}
+
+		if (min > max)
+			min = max = std::numeric_limits<float>::quiet_NaN();
+	}
+
+	// Calls function(row, min, max) for every row, with rows grouped into bands of about
+	// PixelsPerBand that the threads take in turn. Every band tracks its own min and max
+	template<typename Function>
+	static void forEachBand(size_t width, size_t height, unsigned int threads, std::vector<float> & bandMin, std::vector<float> & bandMax, Function function)
+	{
+		const size_t rowsPerBand = std::max<size_t>(1, PixelsPerBand / width);
+		const size_t bands = (height + rowsPerBand - 1) / rowsPerBand;
+		bandMin.assign(bands, std::numeric_limits<float>::infinity());
+		bandMax.assign(bands, -std::numeric_limits<float>::infinity());
+
+		if (threads == 0)
+			threads = std::max(1u, std::thread::hardware_concurrency());
+		threads = (unsigned int)std::min<size_t>(threads, bands);
+
+		std::atomic<size_t> next(0);
+		auto worker = [&]()
+		{
+			for (size_t band = next.fetch_add(1); band < bands; band = next.fetch_add(1))
+			{
+				const size_t last = std::min(height, (band + 1) * rowsPerBand);
+				for (size_t row = band * rowsPerBand; row < last; row++)
+					function(row, bandMin[band], bandMax[band]);
+			}
+		};
+
+		std::vector<std::thread> pool;
+		for (unsigned int t = 1; t < threads; t++)
+			pool.push_back(std::thread(worker));
+		worker();
+		for (size_t t = 0; t < pool.size(); t++)
+			pool[t].join();
+	}
+};
+
+#endif
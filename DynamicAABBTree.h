@@ -0,0 +1,546 @@
+#ifndef _DYNAMIC_AABB_TREE_H_
+#define _DYNAMIC_AABB_TREE_H_
+
+/*
+LICENSE - this file is public domain
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "AABB.h"
+
+/*
+ Broadphase for moving objects, after the dynamic tree in Box2D. Every proxy is a leaf holding
+ a "fat" box: the object's box grown by a margin and stretched in the direction it is moving,
+ so most frames an object stays inside its fat box and the tree is not touched at all. When
+ it does leave, the leaf is removed and reinserted where it grows the tree the least, and the
+ nodes on the way up are rebalanced with AVL style rotations.
+
+ Nodes live in one pooled array with a free list; proxy ids are node indices and stay valid
+ until destroyProxy(). Proxies that were created or reinserted since the last updatePairs()
+ are kept in a move buffer, and updatePairs() only looks for new overlaps of those.
+ */
+
+static const int32_t DynamicAABBTreeNullNode = -1;
+
+template<typename T, typename ElementType, unsigned int DIMENSIONS>
+class DynamicAABBTree
+{
+public:
+	// margin grows every fat box on all sides; displacement passed to moveProxy() is scaled
+	// by displacementMultiplier to predict where the object is heading
+	DynamicAABBTree(ElementType margin = ElementType(0.1), ElementType displacementMultiplier = ElementType(4), int initialCapacity = 16)
+		:_root(DynamicAABBTreeNullNode)
+		,_freeList(DynamicAABBTreeNullNode)
+		,_proxyCount(0)
+		,_margin(margin)
+		,_displacementMultiplier(displacementMultiplier)
+	{
+		grow(std::max(initialCapacity, 1));
+	}
+
+	template<long MIN, long MAX>
+	int32_t createProxy(const AABB<T, ElementType, DIMENSIONS, MIN, MAX> & box, unsigned int userData)
+	{
+		const int32_t proxy = allocateNode();
+		Node & node = _nodes[proxy];
+		T min;
+		T max;
+		box.getMinMax(min, max);
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+		{
+			node.min[dim] = min[dim] - _margin;
+			node.max[dim] = max[dim] + _margin;
+		}
+		node.userData = userData;
+		node.height = 0;
+		node.moved = true;
+
+		insertLeaf(proxy);
+		_moveBuffer.push_back(proxy);
+		_proxyCount++;
+		return proxy;
+	}
+
+	void destroyProxy(int32_t proxy)
+	{
+		if (_nodes[proxy].moved)
+			std::replace(_moveBuffer.begin(), _moveBuffer.end(), proxy, DynamicAABBTreeNullNode);
+
+		removeLeaf(proxy);
+		freeNode(proxy);
+		_proxyCount--;
+	}
+
+	// Returns true if the proxy had to be reinserted, false if box is still inside its fat box.
+	template<long MIN, long MAX>
+	bool moveProxy(int32_t proxy, const AABB<T, ElementType, DIMENSIONS, MIN, MAX> & box, const T & displacement)
+	{
+		T min;
+		T max;
+		box.getMinMax(min, max);
+
+		Node & node = _nodes[proxy];
+		ElementType fatMin[DIMENSIONS];
+		ElementType fatMax[DIMENSIONS];
+		bool inside = true;
+		bool tooLarge = false;
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+		{
+			fatMin[dim] = min[dim] - _margin;
+			fatMax[dim] = max[dim] + _margin;
+			const ElementType predicted = _displacementMultiplier * displacement[dim];
+			if (predicted < 0)
+				fatMin[dim] += predicted;
+			else
+				fatMax[dim] += predicted;
+
+			inside = inside && node.min[dim] <= min[dim] && max[dim] <= node.max[dim];
+			// a fat box left over from a fast move should shrink again once the object slows down
+			tooLarge = tooLarge || node.min[dim] < fatMin[dim] - 4 * _margin || node.max[dim] > fatMax[dim] + 4 * _margin;
+		}
+
+		if (inside && !tooLarge)
+			return false;
+
+		removeLeaf(proxy);
+		std::copy(fatMin, fatMin + DIMENSIONS, node.min);
+		std::copy(fatMax, fatMax + DIMENSIONS, node.max);
+		// may grow the pool, so node is not used past this point
+		insertLeaf(proxy);
+
+		if (!_nodes[proxy].moved)
+		{
+			_nodes[proxy].moved = true;
+			_moveBuffer.push_back(proxy);
+		}
+		return true;
+	}
+
+	unsigned int userData(int32_t proxy) const { return _nodes[proxy].userData; }
+
+	void getFatMinMax(int32_t proxy, T & min, T & max) const
+	{
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+		{
+			min[dim] = _nodes[proxy].min[dim];
+			max[dim] = _nodes[proxy].max[dim];
+		}
+	}
+
+	// calls callback(proxy) for every proxy whose fat box overlaps box, until it returns false
+	template<long MIN, long MAX, typename Callback>
+	void query(const AABB<T, ElementType, DIMENSIONS, MIN, MAX> & box, Callback callback) const
+	{
+		T min;
+		T max;
+		box.getMinMax(min, max);
+		ElementType queryMin[DIMENSIONS];
+		ElementType queryMax[DIMENSIONS];
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+		{
+			queryMin[dim] = min[dim];
+			queryMax[dim] = max[dim];
+		}
+		query(queryMin, queryMax, callback);
+	}
+
+	/*
+	 Calls callback(proxyA, proxyB) once for every pair of overlapping fat boxes where at least
+	 one of the two was created or reinserted since the last call, then clears the move buffer.
+	 Pairs of proxies that both stayed inside their fat boxes were reported before and are not
+	 tested again.
+	 */
+	template<typename Callback>
+	void updatePairs(Callback callback)
+	{
+		_pairs.clear();
+		for (size_t i = 0; i < _moveBuffer.size(); i++)
+		{
+			const int32_t queryProxy = _moveBuffer[i];
+			if (queryProxy == DynamicAABBTreeNullNode)
+				continue;
+
+			const Node & queryNode = _nodes[queryProxy];
+			query(queryNode.min, queryNode.max, [&](int32_t proxy) -> bool
+			{
+				// when both moved, only the query from the lower id reports the pair
+				if (proxy == queryProxy || (_nodes[proxy].moved && proxy < queryProxy))
+					return true;
+
+				_pairs.push_back(std::make_pair(std::min(proxy, queryProxy), std::max(proxy, queryProxy)));
+				return true;
+			});
+		}
+
+		for (size_t i = 0; i < _moveBuffer.size(); i++)
+		{
+			if (_moveBuffer[i] != DynamicAABBTreeNullNode)
+				_nodes[_moveBuffer[i]].moved = false;
+		}
+		_moveBuffer.clear();
+
+		for (size_t i = 0; i < _pairs.size(); i++)
+			callback(_pairs[i].first, _pairs[i].second);
+	}
+
+	int proxyCount() const { return _proxyCount; }
+	int height() const { return _root == DynamicAABBTreeNullNode ? 0 : _nodes[_root].height; }
+
+private:
+	struct Node
+	{
+		ElementType min[DIMENSIONS];
+		ElementType max[DIMENSIONS];
+		unsigned int userData;
+		// next free node while on the free list
+		int32_t parent;
+		int32_t child1;
+		int32_t child2;
+		// 0 for leaves, -1 for free nodes
+		int32_t height;
+		bool moved;
+
+		bool isLeaf() const { return child1 == DynamicAABBTreeNullNode; }
+	};
+
+	std::vector<Node> _nodes;
+	int32_t _root;
+	int32_t _freeList;
+	int _proxyCount;
+	ElementType _margin;
+	ElementType _displacementMultiplier;
+	std::vector<int32_t> _moveBuffer;
+	std::vector<std::pair<int32_t, int32_t>> _pairs;
+
+	template<typename Callback>
+	void query(const ElementType * min, const ElementType * max, Callback callback) const
+	{
+		if (_root == DynamicAABBTreeNullNode)
+			return;
+
+		// the tree stays balanced, so the fixed part is enough unless it is enormous
+		int32_t fixedStack[128];
+		std::vector<int32_t> overflow;
+		int top = 0;
+		fixedStack[top++] = _root;
+		while (top > 0 || !overflow.empty())
+		{
+			int32_t nodeIndex;
+			if (!overflow.empty())
+			{
+				nodeIndex = overflow.back();
+				overflow.pop_back();
+			}
+			else
+				nodeIndex = fixedStack[--top];
+
+			const Node & node = _nodes[nodeIndex];
+			if (!overlaps(node, min, max))
+				continue;
+
+			if (node.isLeaf())
+			{
+				if (!callback(nodeIndex))
+					return;
+				continue;
+			}
+
+			if (top + 2 <= 128)
+			{
+				fixedStack[top++] = node.child1;
+				fixedStack[top++] = node.child2;
+			}
+			else
+			{
+				overflow.push_back(node.child1);
+				overflow.push_back(node.child2);
+			}
+		}
+	}
+
+	void grow(int capacity)
+	{
+		const int oldCapacity = int(_nodes.size());
+		_nodes.resize(size_t(capacity));
+		for (int i = oldCapacity; i < capacity; i++)
+		{
+			_nodes[i].parent = i + 1 < capacity ? i + 1 : _freeList;
+			_nodes[i].height = -1;
+		}
+		_freeList = oldCapacity;
+	}
+
+	int32_t allocateNode()
+	{
+		if (_freeList == DynamicAABBTreeNullNode)
+			grow(int(_nodes.size()) * 2);
+
+		const int32_t index = _freeList;
+		Node & node = _nodes[index];
+		_freeList = node.parent;
+		node.parent = DynamicAABBTreeNullNode;
+		node.child1 = DynamicAABBTreeNullNode;
+		node.child2 = DynamicAABBTreeNullNode;
+		node.height = 0;
+		node.userData = 0;
+		node.moved = false;
+		return index;
+	}
+
+	void freeNode(int32_t index)
+	{
+		_nodes[index].parent = _freeList;
+		_nodes[index].height = -1;
+		_freeList = index;
+	}
+
+	void insertLeaf(int32_t leaf)
+	{
+		if (_root == DynamicAABBTreeNullNode)
+		{
+			_root = leaf;
+			_nodes[leaf].parent = DynamicAABBTreeNullNode;
+			return;
+		}
+
+		// find the sibling that grows the tree's total area the least
+		const Node leafNode = _nodes[leaf];
+		int32_t index = _root;
+		while (!_nodes[index].isLeaf())
+		{
+			const Node & node = _nodes[index];
+			const ElementType nodeArea = area(node.min, node.max);
+			const ElementType combinedArea = combinedAreaOf(node, leafNode);
+
+			// cost of a new parent for this node and the leaf, and the minimum cost of pushing
+			// the leaf further down, which grows this node's box anyway
+			const ElementType cost = 2 * combinedArea;
+			const ElementType inheritanceCost = 2 * (combinedArea - nodeArea);
+			const ElementType cost1 = descendCost(node.child1, leafNode) + inheritanceCost;
+			const ElementType cost2 = descendCost(node.child2, leafNode) + inheritanceCost;
+			if (cost < cost1 && cost < cost2)
+				break;
+
+			index = cost1 < cost2 ? node.child1 : node.child2;
+		}
+
+		const int32_t sibling = index;
+		const int32_t oldParent = _nodes[sibling].parent;
+		const int32_t newParent = allocateNode();
+		Node & parent = _nodes[newParent];
+		parent.parent = oldParent;
+		combine(parent, _nodes[sibling], leafNode);
+		parent.height = _nodes[sibling].height + 1;
+		parent.child1 = sibling;
+		parent.child2 = leaf;
+		_nodes[sibling].parent = newParent;
+		_nodes[leaf].parent = newParent;
+
+		if (oldParent != DynamicAABBTreeNullNode)
+		{
+			if (_nodes[oldParent].child1 == sibling)
+				_nodes[oldParent].child1 = newParent;
+			else
+				_nodes[oldParent].child2 = newParent;
+		}
+		else
+			_root = newParent;
+
+		refit(_nodes[leaf].parent);
+	}
+
+	void removeLeaf(int32_t leaf)
+	{
+		if (leaf == _root)
+		{
+			_root = DynamicAABBTreeNullNode;
+			return;
+		}
+
+		const int32_t parent = _nodes[leaf].parent;
+		const int32_t grandParent = _nodes[parent].parent;
+		const int32_t sibling = _nodes[parent].child1 == leaf ? _nodes[parent].child2 : _nodes[parent].child1;
+
+		if (grandParent != DynamicAABBTreeNullNode)
+		{
+			if (_nodes[grandParent].child1 == parent)
+				_nodes[grandParent].child1 = sibling;
+			else
+				_nodes[grandParent].child2 = sibling;
+			_nodes[sibling].parent = grandParent;
+			freeNode(parent);
+			refit(grandParent);
+		}
+		else
+		{
+			_root = sibling;
+			_nodes[sibling].parent = DynamicAABBTreeNullNode;
+			freeNode(parent);
+		}
+	}
+
+	// rebalances and recomputes boxes and heights from index up to the root
+	void refit(int32_t index)
+	{
+		while (index != DynamicAABBTreeNullNode)
+		{
+			index = balance(index);
+			Node & node = _nodes[index];
+			const Node & child1 = _nodes[node.child1];
+			const Node & child2 = _nodes[node.child2];
+			node.height = 1 + std::max(child1.height, child2.height);
+			combine(node, child1, child2);
+			index = node.parent;
+		}
+	}
+
+	// If a's subtrees differ in height by more than one, rotates the higher child up and
+	// returns the index of the node now in a's place.
+	int32_t balance(int32_t a)
+	{
+		Node & nodeA = _nodes[a];
+		if (nodeA.isLeaf() || nodeA.height < 2)
+			return a;
+
+		const int32_t b = nodeA.child1;
+		const int32_t c = nodeA.child2;
+		const int32_t difference = _nodes[c].height - _nodes[b].height;
+		if (difference > 1)
+			return rotateUp(a, c, false);
+		if (difference < -1)
+			return rotateUp(a, b, true);
+		return a;
+	}
+
+	// moves child (a's first child if isFirst, else its second) into a's place
+	int32_t rotateUp(int32_t a, int32_t child, bool isFirst)
+	{
+		Node & nodeA = _nodes[a];
+		Node & nodeChild = _nodes[child];
+		const int32_t other = isFirst ? nodeA.child2 : nodeA.child1;
+		const int32_t grandChild1 = nodeChild.child1;
+		const int32_t grandChild2 = nodeChild.child2;
+
+		nodeChild.child1 = a;
+		nodeChild.parent = nodeA.parent;
+		nodeA.parent = child;
+
+		if (nodeChild.parent != DynamicAABBTreeNullNode)
+		{
+			Node & parent = _nodes[nodeChild.parent];
+			if (parent.child1 == a)
+				parent.child1 = child;
+			else
+				parent.child2 = child;
+		}
+		else
+			_root = child;
+
+		// the higher grandchild stays with child, the other one goes to a
+		const bool keepFirst = _nodes[grandChild1].height > _nodes[grandChild2].height;
+		const int32_t kept = keepFirst ? grandChild1 : grandChild2;
+		const int32_t moved = keepFirst ? grandChild2 : grandChild1;
+		nodeChild.child2 = kept;
+		if (isFirst)
+			nodeA.child1 = moved;
+		else
+			nodeA.child2 = moved;
+		_nodes[moved].parent = a;
+
+		combine(nodeA, _nodes[other], _nodes[moved]);
+		nodeA.height = 1 + std::max(_nodes[other].height, _nodes[moved].height);
+		combine(nodeChild, nodeA, _nodes[kept]);
+		nodeChild.height = 1 + std::max(nodeA.height, _nodes[kept].height);
+		return child;
+	}
+
+	ElementType descendCost(int32_t child, const Node & leaf) const
+	{
+		const Node & node = _nodes[child];
+		const ElementType combinedArea = combinedAreaOf(node, leaf);
+		return node.isLeaf() ? combinedArea : combinedArea - area(node.min, node.max);
+	}
+
+	static inline ElementType combinedAreaOf(const Node & a, const Node & b)
+	{
+		ElementType min[DIMENSIONS];
+		ElementType max[DIMENSIONS];
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+		{
+			min[dim] = std::min(a.min[dim], b.min[dim]);
+			max[dim] = std::max(a.max[dim], b.max[dim]);
+		}
+		return area(min, max);
+	}
+
+	static inline void combine(Node & into, const Node & a, const Node & b)
+	{
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+		{
+			into.min[dim] = std::min(a.min[dim], b.min[dim]);
+			into.max[dim] = std::max(a.max[dim], b.max[dim]);
+		}
+	}
+
+	static inline bool overlaps(const Node & node, const ElementType * min, const ElementType * max)
+	{
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+		{
+			if (max[dim] < node.min[dim] || min[dim] > node.max[dim])
+				return false;
+		}
+		return true;
+	}
+
+	// half the surface area in 3D, half the perimeter in 2D
+	static inline ElementType area(const ElementType * min, const ElementType * max)
+	{
+		if (DIMENSIONS == 1)
+			return max[0] - min[0];
+
+		ElementType sum = 0;
+		for (unsigned int skip = 0; skip < DIMENSIONS; skip++)
+		{
+			ElementType product = 1;
+			for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+			{
+				if (dim != skip)
+					product *= max[dim] - min[dim];
+			}
+			sum += product;
+		}
+		return sum;
+	}
+};
+
+#endif
@@ -31,6 +31,12 @@
  
  */
 
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
 class Palette
 {
 public:
@@ -41,15 +47,204 @@ public:
         constexpr T twopi = T(6.28318530718);
         for(unsigned int i=0 ; i < DIMENSIONS ; i++)
         {
-			const float a = palette[0][i];
-			const float b = palette[1][i];
-			const float c = palette[2][i];
-			const float d = palette[3][i];
-			T val = a + (b-a) * cos(twopi * ((d-c) * t +  c));
+			const T a = palette[0][i];
+			const T b = palette[1][i];
+			const T c = palette[2][i];
+			const T d = palette[3][i];
+			T val = a + (b-a) * std::cos(twopi * ((d-c) * t +  c));
             result[i] = val;
         }
-    };
-    
+    }
+
+    // same as above, with cos2Pi() instead of cos()
+    template<typename T, unsigned int DIMENSIONS>
+    static void inigoQuilezFast(const T t, const T palette[4][DIMENSIONS], T result[DIMENSIONS])
+    {
+        for(unsigned int i=0 ; i < DIMENSIONS ; i++)
+        {
+            const T a = palette[0][i];
+            const T b = palette[1][i];
+            const T c = palette[2][i];
+            const T d = palette[3][i];
+            result[i] = a + (b-a) * cos2Pi((d-c) * t + c);
+        }
+    }
+
+    // colours count values of t into result, DIMENSIONS interleaved values per sample. Each
+    // channel is computed for a block of samples at a time, a loop with no calls or branches
+    // that the compiler vectorises, and then interleaved into result
+    template<typename T, unsigned int DIMENSIONS>
+    static void inigoQuilez(const T * t, size_t count, const T palette[4][DIMENSIONS], T * result)
+    {
+        const size_t Block = 256;
+        T channel[Block];
+        for(size_t first=0 ; first < count ; first += Block)
+        {
+            const size_t samples = std::min(Block, count - first);
+            for(unsigned int i=0 ; i < DIMENSIONS ; i++)
+            {
+                const T offset = palette[0][i];
+                const T scale = palette[1][i] - palette[0][i];
+                const T phase = palette[2][i];
+                const T frequency = palette[3][i] - palette[2][i];
+                // a constant trip count lets -O2 vectorise the full blocks
+                if(samples == Block)
+                {
+                    for(size_t s=0 ; s < Block ; s++)
+                        channel[s] = offset + scale * cos2Pi(frequency * t[first + s] + phase);
+                }
+                else
+                {
+                    for(size_t s=0 ; s < samples ; s++)
+                        channel[s] = offset + scale * cos2Pi(frequency * t[first + s] + phase);
+                }
+
+                T * out = result + first * DIMENSIONS + i;
+                for(size_t s=0 ; s < samples ; s++)
+                    out[s * DIMENSIONS] = channel[s];
+            }
+        }
+    }
+
+    // cos(2*pi*turns), branch free. The absolute error is below 1e-9, so it is as good as
+    // std::cos for float. turns must be within the range of int32_t
+    template<typename T>
+    static inline T cos2Pi(const T turns)
+    {
+        // cos is even and has period 1 in turns, so fold into [0, 0.5], then
+        // cos(2*pi*x) = sin(2*pi*(0.25 - x)) with the argument in [-pi/2, pi/2]
+        T x = turns - T(int32_t(turns));
+        x = x < T(0) ? -x : x;
+        x = std::min(x, T(1) - x);
+        const T z = T(6.28318530717958647692) * (T(0.25) - x);
+        const T z2 = z * z;
+        T p = T(1.0 / 6227020800.0);
+        p = p * z2 - T(1.0 / 39916800.0);
+        p = p * z2 + T(1.0 / 362880.0);
+        p = p * z2 - T(1.0 / 5040.0);
+        p = p * z2 + T(1.0 / 120.0);
+        p = p * z2 - T(1.0 / 6.0);
+        p = p * z2 + T(1);
+        return p * z;
+    }
+};
+
+/*
+ A palette baked into a table of resolution entries over t in [0,1], read back with linear
+ interpolation, so colouring costs two table reads instead of a cos per channel. Values of t
+ outside [0,1] are clamped and NaN maps to 0. The table is kept both as T and as 8 bit per
+ channel (RGBA8 for DIMENSIONS 4, RGB8 with alpha 255 for DIMENSIONS 3, one byte per channel
+ otherwise).
+
+ bake() takes any function of t, so a transfer function such as sRGB encoding can be folded
+ into the table.
+ */
+template<typename T, unsigned int DIMENSIONS>
+class PaletteTable
+{
+public:
+    static const unsigned int BYTES = DIMENSIONS == 3 ? 4 : DIMENSIONS;
+
+    PaletteTable(const T palette[4][DIMENSIONS], unsigned int resolution = 256)
+    {
+        bake([palette](T t, T result[DIMENSIONS]) { Palette::inigoQuilez<T, DIMENSIONS>(t, palette, result); }, resolution);
+    }
+
+    PaletteTable()
+        :_resolution(0)
+        ,_scale(0)
+    {
+    }
+
+    // function is called as function(T t, T result[DIMENSIONS])
+    template<typename Function>
+    void bake(Function function, unsigned int resolution)
+    {
+        _resolution = std::max(2u, resolution);
+        _scale = T(_resolution - 1);
+
+        // one extra entry repeating the last so index + 1 is always valid
+        _values.resize((_resolution + 1) * DIMENSIONS);
+        _bytes.resize((_resolution + 1) * BYTES);
+        for(unsigned int e=0 ; e <= _resolution ; e++)
+        {
+            T * value = &_values[e * DIMENSIONS];
+            function(T(std::min(e, _resolution - 1)) / _scale, value);
+
+            uint8_t * byte = &_bytes[e * BYTES];
+            byte[BYTES - 1] = 255;
+            for(unsigned int i=0 ; i < DIMENSIONS ; i++)
+                byte[i] = quantize(value[i]);
+        }
+    }
+
+    void evaluate(const T t, T result[DIMENSIONS]) const
+    {
+        unsigned int index;
+        T weight;
+        locate(t, index, weight);
+        const T * low = &_values[index * DIMENSIONS];
+        for(unsigned int i=0 ; i < DIMENSIONS ; i++)
+            result[i] = low[i] + (low[i + DIMENSIONS] - low[i]) * weight;
+    }
+
+    // count samples, DIMENSIONS interleaved values each
+    void evaluate(const T * t, size_t count, T * result) const
+    {
+        const T * values = &_values[0];
+        for(size_t s=0 ; s < count ; s++)
+        {
+            unsigned int index;
+            T weight;
+            locate(t[s], index, weight);
+            const T * low = values + index * DIMENSIONS;
+            for(unsigned int i=0 ; i < DIMENSIONS ; i++)
+                result[s*DIMENSIONS + i] = low[i] + (low[i + DIMENSIONS] - low[i]) * weight;
+        }
+    }
+
+    // count samples, BYTES interleaved bytes each, interpolated in 8.8 fixed point
+    void evaluateBytes(const T * t, size_t count, uint8_t * result) const
+    {
+        const uint8_t * bytes = &_bytes[0];
+        const T fixedScale = _scale * T(256);
+        for(size_t s=0 ; s < count ; s++)
+        {
+            T position = t[s] * fixedScale;
+            position = position > T(0) ? position : T(0);
+            position = position < fixedScale ? position : fixedScale;
+            const unsigned int fixed = (unsigned int)position;
+            const unsigned int weight = fixed & 255;
+            const uint8_t * low = bytes + (fixed >> 8) * BYTES;
+            for(unsigned int i=0 ; i < BYTES ; i++)
+                result[s*BYTES + i] = uint8_t((low[i] * (256 - weight) + low[i + BYTES] * weight + 128) >> 8);
+        }
+    }
+
+    unsigned int resolution() const { return _resolution; }
+    const std::vector<T> & values() const { return _values; }
+    const std::vector<uint8_t> & bytes() const { return _bytes; }
+
+    static inline uint8_t quantize(const T value)
+    {
+        const T clamped = value > T(0) ? (value < T(1) ? value : T(1)) : T(0);
+        return uint8_t(clamped * T(255) + T(0.5));
+    }
+
+private:
+    unsigned int _resolution;
+    T _scale;
+    std::vector<T> _values;
+    std::vector<uint8_t> _bytes;
+
+    inline void locate(const T t, unsigned int & index, T & weight) const
+    {
+        T position = t * _scale;
+        position = position > T(0) ? position : T(0);
+        position = position < _scale ? position : _scale;
+        index = (unsigned int)position;
+        weight = position - T(index);
+    }
 };
 
 #endif
@@ -0,0 +1,385 @@
+#ifndef _POISSON_DISK_H_
+#define _POISSON_DISK_H_
+
+/*
+LICENSE - this file is public domain
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#include "AABB.h"
+#include "Random.h"
+
+/*
+ Blue noise points with no two closer than radius (Bridson, "Fast Poisson Disk Sampling in
+ Arbitrary Dimensions", 2007), in linear time.
+
+ A background grid with cells of radius / sqrt(DIMENSIONS) holds at most one point per cell,
+ so a candidate only has to be tested against the 5^DIMENSIONS cells around it. Candidates
+ are drawn from the annulus [radius, 2 radius) around an active point, by rejection from the
+ enclosing cube.
+
+ generateParallel() splits the grid into tiles and fills them in 2^DIMENSIONS checkerboard
+ phases. Tiles of the same phase are at least a tile apart, so they never read what another
+ thread is writing, and each tile draws from its own random stream: the result depends
+ on the seed and the tile size only, never on the number of threads.
+
+ T is any point type indexable with [] (as used by AABB), for example glm::vec2.
+ */
+template<typename T, typename ElementType, unsigned int DIMENSIONS>
+class PoissonDisk
+{
+	static_assert(DIMENSIONS == 2 || DIMENSIONS == 3, "PoissonDisk supports 2 and 3 dimensions");
+
+public:
+	PoissonDisk(const T & min, const T & max, ElementType radius, int attempts = 30)
+		:_radius(radius)
+		,_attempts(attempts)
+	{
+		_cellSize = double(radius) / std::sqrt(double(DIMENSIONS));
+		_cellCount = 1;
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+		{
+			_min[dim] = double(min[dim]);
+			_max[dim] = double(max[dim]);
+			_gridSize[dim] = std::max(1, int(std::ceil((_max[dim] - _min[dim]) / _cellSize)));
+			_cellCount *= size_t(_gridSize[dim] + 2 * Reach);
+		}
+
+		// linear offsets of the cells that can hold a point closer than radius; the grid has
+		// a border of Reach empty cells so these never need clipping
+		int offset[DIMENSIONS];
+		int lower[DIMENSIONS];
+		int upper[DIMENSIONS];
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+		{
+			lower[dim] = -Reach;
+			upper[dim] = Reach + 1;
+			offset[dim] = lower[dim];
+		}
+		for (;;)
+		{
+			int gaps = 0;
+			ptrdiff_t linear = 0;
+			for (int dim = int(DIMENSIONS) - 1; dim >= 0; dim--)
+			{
+				const int gap = std::max(std::abs(offset[dim]) - 1, 0);
+				gaps += gap * gap;
+				linear = linear * ptrdiff_t(_gridSize[dim] + 2 * Reach) + offset[dim];
+			}
+			if (gaps < int(DIMENSIONS))
+				_neighbourOffsets.push_back(linear);
+			if (!step(offset, lower, upper))
+				break;
+		}
+	}
+
+	template<long MIN, long MAX>
+	PoissonDisk(const AABB<T, ElementType, DIMENSIONS, MIN, MAX> & domain, ElementType radius, int attempts = 30)
+		:PoissonDisk(domain.getMin(), domain.getMax(), radius, attempts)
+	{
+	}
+
+	// single threaded; replaces the content of points
+	void generate(std::vector<T> & points, uint64_t seed)
+	{
+		int tileCells = 0;
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+			tileCells = std::max(tileCells, _gridSize[dim]);
+
+		run(points, seed, 1, tileCells);
+	}
+
+	// Tiles are tileCells grid cells wide (at least 8). threads = 0 uses every hardware thread.
+	void generateParallel(std::vector<T> & points, uint64_t seed, unsigned int threads = 0, int tileCells = 16)
+	{
+		if (threads == 0)
+			threads = std::max(1u, std::thread::hardware_concurrency());
+
+		run(points, seed, threads, std::max(tileCells, 8));
+	}
+
+	size_t cellCount() const { return _cellCount; }
+
+private:
+	// cells within this many cells of a point's cell can hold a point closer than radius
+	static const int Reach = 2;
+
+	double _min[DIMENSIONS];
+	double _max[DIMENSIONS];
+	double _cellSize;
+	ElementType _radius;
+	int _attempts;
+	int _gridSize[DIMENSIONS];
+	size_t _cellCount;
+	std::vector<ptrdiff_t> _neighbourOffsets;
+
+	// DIMENSIONS coordinates per cell, infinity in empty cells
+	std::vector<ElementType> _cells;
+
+	struct Tile
+	{
+		int lower[DIMENSIONS];
+		int upper[DIMENSIONS];
+		std::vector<ElementType> points;
+	};
+
+	void run(std::vector<T> & points, uint64_t seed, unsigned int threads, int tileCells)
+	{
+		_cells.assign(_cellCount * DIMENSIONS, std::numeric_limits<ElementType>::infinity());
+
+		int tileCount[DIMENSIONS];
+		size_t totalTiles = 1;
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+		{
+			tileCount[dim] = (_gridSize[dim] + tileCells - 1) / tileCells;
+			totalTiles *= size_t(tileCount[dim]);
+		}
+
+		// tiles grouped by phase, the parity of their tile coordinates
+		std::vector<Tile> tiles(totalTiles);
+		std::vector<size_t> phases[1 << DIMENSIONS];
+		for (size_t index = 0; index < totalTiles; index++)
+		{
+			size_t remaining = index;
+			int phase = 0;
+			for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+			{
+				const int coordinate = int(remaining % size_t(tileCount[dim]));
+				remaining /= size_t(tileCount[dim]);
+				tiles[index].lower[dim] = coordinate * tileCells;
+				tiles[index].upper[dim] = std::min(_gridSize[dim], (coordinate + 1) * tileCells);
+				phase |= (coordinate & 1) << dim;
+			}
+			phases[phase].push_back(index);
+		}
+
+		for (int phase = 0; phase < (1 << DIMENSIONS); phase++)
+		{
+			const std::vector<size_t> & phaseTiles = phases[phase];
+			std::atomic<size_t> next(0);
+			auto worker = [&]()
+			{
+				for (size_t i = next.fetch_add(1); i < phaseTiles.size(); i = next.fetch_add(1))
+				{
+					// each tile gets its own stream, seeded from a Philox4x32 counter
+					Xoshiro256StarStar engine(Philox4x32::sample64(seed, phaseTiles[i], 0));
+					fillTile(tiles[phaseTiles[i]], engine);
+				}
+			};
+
+			const unsigned int workers = (unsigned int)std::min<size_t>(threads, phaseTiles.size());
+			std::vector<std::thread> pool;
+			for (unsigned int i = 1; i < workers; i++)
+				pool.push_back(std::thread(worker));
+			worker();
+			for (size_t i = 0; i < pool.size(); i++)
+				pool[i].join();
+		}
+
+		size_t total = 0;
+		for (size_t index = 0; index < totalTiles; index++)
+			total += tiles[index].points.size() / DIMENSIONS;
+
+		points.clear();
+		points.reserve(total);
+		for (size_t index = 0; index < totalTiles; index++)
+		{
+			const std::vector<ElementType> & coordinates = tiles[index].points;
+			for (size_t i = 0; i < coordinates.size(); i += DIMENSIONS)
+			{
+				T point;
+				for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+					point[dim] = coordinates[i + dim];
+				points.push_back(point);
+			}
+		}
+
+		_cells = std::vector<ElementType>();
+	}
+
+	void fillTile(Tile & tile, Xoshiro256StarStar & engine)
+	{
+		const double radius = double(_radius);
+		const double radius2 = radius * radius;
+		std::vector<double> active;
+
+		// points already placed by neighbouring tiles, close enough to spawn candidates here
+		int lower[DIMENSIONS];
+		int upper[DIMENSIONS];
+		int cell[DIMENSIONS];
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+		{
+			lower[dim] = std::max(0, tile.lower[dim] - Reach * 2);
+			upper[dim] = std::min(_gridSize[dim], tile.upper[dim] + Reach * 2);
+			cell[dim] = lower[dim];
+		}
+		for (;;)
+		{
+			const size_t index = cellIndex(cell);
+			if (!std::isinf(_cells[index * DIMENSIONS]) && !insideTile(tile, cell))
+				active.insert(active.end(), &_cells[index * DIMENSIONS], &_cells[index * DIMENSIONS] + DIMENSIONS);
+			if (!step(cell, lower, upper))
+				break;
+		}
+
+		// and one dart thrown into the tile itself
+		double candidate[DIMENSIONS];
+		for (int attempt = 0; attempt < _attempts; attempt++)
+		{
+			for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+			{
+				const double from = _min[dim] + double(tile.lower[dim]) * _cellSize;
+				const double to = std::min(_max[dim], _min[dim] + double(tile.upper[dim]) * _cellSize);
+				candidate[dim] = from + (to - from) * uniform(engine);
+			}
+			if (tryInsert(tile, candidate, radius2))
+			{
+				active.insert(active.end(), candidate, candidate + DIMENSIONS);
+				break;
+			}
+		}
+
+		while (!active.empty())
+		{
+			const size_t count = active.size() / DIMENSIONS;
+			const size_t chosen = RandomBits::toRange(engine.next32(), count);
+			const double * origin = &active[chosen * DIMENSIONS];
+
+			bool found = false;
+			for (int attempt = 0; attempt < _attempts && !found; attempt++)
+			{
+				double offset[DIMENSIONS];
+				double length2 = 0.0;
+				do
+				{
+					length2 = 0.0;
+					for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+					{
+						offset[dim] = (uniform(engine) * 4.0 - 2.0) * radius;
+						length2 += offset[dim] * offset[dim];
+					}
+				} while (length2 < radius2 || length2 >= 4.0 * radius2);
+
+				for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+					candidate[dim] = origin[dim] + offset[dim];
+				found = tryInsert(tile, candidate, radius2);
+			}
+
+			if (found)
+				active.insert(active.end(), candidate, candidate + DIMENSIONS);
+			else
+			{
+				std::copy(active.end() - DIMENSIONS, active.end(), active.begin() + chosen * DIMENSIONS);
+				active.resize(active.size() - DIMENSIONS);
+			}
+		}
+	}
+
+	// Adds candidate to the grid and the tile if it is inside the tile and far enough from
+	// everything. Rounds candidate to ElementType first, so the spacing holds for the output.
+	bool tryInsert(Tile & tile, double * candidate, double radius2)
+	{
+		int cell[DIMENSIONS];
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+		{
+			candidate[dim] = double(ElementType(candidate[dim]));
+			if (candidate[dim] < _min[dim] || candidate[dim] >= _max[dim])
+				return false;
+			cell[dim] = std::min(_gridSize[dim] - 1, int((candidate[dim] - _min[dim]) / _cellSize));
+		}
+
+		if (!insideTile(tile, cell))
+			return false;
+
+		// empty cells hold infinity, so their distance never passes the test
+		const size_t index = cellIndex(cell);
+		const ElementType * centre = &_cells[index * DIMENSIONS];
+		for (size_t i = 0; i < _neighbourOffsets.size(); i++)
+		{
+			const ElementType * neighbour = centre + _neighbourOffsets[i] * ptrdiff_t(DIMENSIONS);
+			double distance2 = 0.0;
+			for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+			{
+				const double delta = double(neighbour[dim]) - candidate[dim];
+				distance2 += delta * delta;
+			}
+			if (distance2 < radius2)
+				return false;
+		}
+
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+		{
+			_cells[index * DIMENSIONS + dim] = ElementType(candidate[dim]);
+			tile.points.push_back(ElementType(candidate[dim]));
+		}
+		return true;
+	}
+
+	static inline double uniform(Xoshiro256StarStar & engine) { return RandomBits::toUnitDouble(engine.next64()); }
+
+	inline size_t cellIndex(const int * cell) const
+	{
+		size_t index = size_t(cell[DIMENSIONS - 1] + Reach);
+		for (int dim = int(DIMENSIONS) - 2; dim >= 0; dim--)
+			index = index * size_t(_gridSize[dim] + 2 * Reach) + size_t(cell[dim] + Reach);
+		return index;
+	}
+
+	static inline bool insideTile(const Tile & tile, const int * cell)
+	{
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+		{
+			if (cell[dim] < tile.lower[dim] || cell[dim] >= tile.upper[dim])
+				return false;
+		}
+		return true;
+	}
+
+	// next cell of the box [lower, upper), false after the last one
+	static inline bool step(int * cell, const int * lower, const int * upper)
+	{
+		for (unsigned int dim = 0; dim < DIMENSIONS; dim++)
+		{
+			if (++cell[dim] < upper[dim])
+				return true;
+			cell[dim] = lower[dim];
+		}
+		return false;
+	}
+};
+
+#endif
@@ -0,0 +1,456 @@
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+/*
+LICENSE - this file is public domain
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+
+ */
+
+/*
+ Usage:
+
+   void query()
+   {
+       PROFILE_SCOPE("KDTree::inside");
+       ...
+   }
+
+   // once per frame (or whenever), from one thread
+   Profiler::instance().collect();
+   printf("%s", Profiler::instance().reportText().c_str());
+
+ Each thread writes its scope timings into its own SPSCRingBuffer, so recording never
+ locks or allocates (apart from the first scope on a new thread). collect() drains every
+ thread's ring. Events are dropped, and counted, if a ring fills up between collects. When a
+ thread exits its ring is drained and kept for the next new thread.
+ Scope names must be string literals or otherwise outlive the profiler.
+ */
+
+#include "RingBuffer.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <new>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <unordered_map>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PROFILER_USE_RDTSC 1
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define PROFILER_USE_RDTSC 1
+#endif
+
+#ifndef PROFILER_THREAD_EVENTS
+#define PROFILER_THREAD_EVENTS (1 << 14)
+#endif
+
+struct ProfileEvent
+{
+	const char * name;
+	uint64_t start;
+	uint64_t end;
+};
+
+class Profiler
+{
+public:
+	struct ScopeReport
+	{
+		std::string name;
+		uint64_t count;
+		double totalNanoseconds;
+		double meanNanoseconds;
+		double p99Nanoseconds;
+		double maxNanoseconds;
+	};
+
+	static Profiler & instance()
+	{
+		static Profiler profiler;
+		return profiler;
+	}
+
+	// timestamp in ticks: TSC cycles where available, steady_clock nanoseconds otherwise
+	static inline uint64_t now()
+	{
+#if defined(PROFILER_USE_RDTSC)
+		return __rdtsc();
+#else
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+
+	static inline void record(const char * name, uint64_t start, uint64_t end)
+	{
+		ThreadBuffer * buffer = threadBuffer();
+		const ProfileEvent event = { name, start, end };
+		if (!buffer->events.push(event))
+			buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// Keeps up to maxEvents raw events from the following collect() calls for chromeTrace().
+	void setTraceCapture(bool enabled, size_t maxEvents = 1 << 20)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_captureTrace = enabled;
+		_maxTraceEvents = maxEvents;
+	}
+
+	// drains every thread's ring into the aggregated statistics. Call from one thread at a time.
+	void collect()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		for (size_t i = 0; i < _threads.size(); i++)
+			drain(*_threads[i]);
+	}
+
+	// clears statistics and captured events, not the per-thread rings
+	void reset()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_scopes.clear();
+		_trace.clear();
+		_dropped = 0;
+	}
+
+	std::vector<ScopeReport> report()
+	{
+		// calibrate() may sleep, so it runs before taking the lock
+		const double nanosecondsPerTick = calibrate();
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		// scopes are keyed by name pointer; the same name can come from several literals
+		std::vector<ScopeReport> reports;
+		std::unordered_map<std::string, size_t> byName;
+		std::unordered_map<std::string, std::vector<uint64_t>> samplesByName;
+		for (auto it = _scopes.begin(); it != _scopes.end(); ++it)
+		{
+			const ScopeData & data = it->second;
+			const std::string name(it->first);
+			auto found = byName.find(name);
+			if (found == byName.end())
+			{
+				found = byName.insert(std::make_pair(name, reports.size())).first;
+				ScopeReport empty = { name, 0, 0, 0, 0, 0 };
+				reports.push_back(empty);
+			}
+
+			ScopeReport & scope = reports[found->second];
+			scope.count += data.count;
+			scope.totalNanoseconds += double(data.totalTicks) * nanosecondsPerTick;
+			scope.maxNanoseconds = std::max(scope.maxNanoseconds, double(data.maxTicks) * nanosecondsPerTick);
+			std::vector<uint64_t> & samples = samplesByName[name];
+			samples.insert(samples.end(), data.samples.begin(), data.samples.end());
+		}
+
+		for (size_t i = 0; i < reports.size(); i++)
+		{
+			ScopeReport & scope = reports[i];
+			scope.meanNanoseconds = scope.count > 0 ? scope.totalNanoseconds / double(scope.count) : 0;
+
+			std::vector<uint64_t> & samples = samplesByName[scope.name];
+			if (!samples.empty())
+			{
+				const size_t rank = std::min(samples.size() - 1, (size_t)(double(samples.size()) * 0.99));
+				std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+				scope.p99Nanoseconds = double(samples[rank]) * nanosecondsPerTick;
+			}
+		}
+
+		std::sort(reports.begin(), reports.end(), [](const ScopeReport & a, const ScopeReport & b) { return a.totalNanoseconds > b.totalNanoseconds; });
+		return reports;
+	}
+
+	std::string reportText()
+	{
+		const std::vector<ScopeReport> reports = report();
+		char line[512];
+		snprintf(line, sizeof(line), "%-40s %12s %14s %12s %12s %12s\n", "scope", "calls", "total ms", "mean ns", "p99 ns", "max ns");
+		std::string text = line;
+		for (size_t i = 0; i < reports.size(); i++)
+		{
+			const ScopeReport & scope = reports[i];
+			snprintf(line, sizeof(line), "%-40s %12llu %14.3f %12.1f %12.1f %12.1f\n", scope.name.c_str(), (unsigned long long)scope.count,
+				scope.totalNanoseconds * 1e-6, scope.meanNanoseconds, scope.p99Nanoseconds, scope.maxNanoseconds);
+			text += line;
+		}
+
+		const uint64_t lost = dropped();
+		if (lost > 0)
+		{
+			snprintf(line, sizeof(line), "%llu events dropped, collect more often or raise PROFILER_THREAD_EVENTS\n", (unsigned long long)lost);
+			text += line;
+		}
+		return text;
+	}
+
+	// captured events in the Chrome trace event format (chrome://tracing, Perfetto)
+	std::string chromeTrace()
+	{
+		const double microsecondsPerTick = calibrate() * 1e-3;
+		std::lock_guard<std::mutex> lock(_mutex);
+		const uint64_t origin = _trace.empty() ? 0 : std::min_element(_trace.begin(), _trace.end(), [](const TraceEvent & a, const TraceEvent & b) { return a.event.start < b.event.start; })->event.start;
+
+		std::string json = "{\"traceEvents\":[";
+		char line[128];
+		for (size_t i = 0; i < _trace.size(); i++)
+		{
+			const TraceEvent & trace = _trace[i];
+			json += i == 0 ? "\n{\"name\":\"" : ",\n{\"name\":\"";
+			for (const char * c = trace.event.name; *c != 0; c++)
+			{
+				if (*c == '"' || *c == '\\')
+					json += '\\';
+				json += *c;
+			}
+			snprintf(line, sizeof(line), "\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", trace.threadId,
+				double(trace.event.start - origin) * microsecondsPerTick, double(trace.event.end - trace.event.start) * microsecondsPerTick);
+			json += line;
+		}
+		json += "\n]}\n";
+		return json;
+	}
+
+	uint64_t dropped() const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _dropped;
+	}
+
+private:
+	struct ThreadBuffer
+	{
+		SPSCRingBuffer<PROFILER_THREAD_EVENTS, ProfileEvent> events;
+		std::atomic<uint64_t> dropped;
+		unsigned int threadId;
+	};
+
+	struct ScopeData
+	{
+		uint64_t count;
+		uint64_t totalTicks;
+		uint64_t maxTicks;
+		// reservoir of durations for the percentile estimate
+		std::vector<uint64_t> samples;
+	};
+
+	struct TraceEvent
+	{
+		ProfileEvent event;
+		unsigned int threadId;
+	};
+
+	static const size_t ReservoirSize = 4096;
+
+	mutable std::mutex _mutex;
+	std::vector<ThreadBuffer *> _threads;
+	std::vector<void *> _threadMemory;
+	// buffers of threads that have exited, drained and ready for the next new thread
+	std::vector<ThreadBuffer *> _freeThreads;
+	unsigned int _nextThreadId;
+	std::unordered_map<const char *, ScopeData> _scopes;
+	std::vector<TraceEvent> _trace;
+	bool _captureTrace;
+	size_t _maxTraceEvents;
+	uint64_t _dropped;
+	uint64_t _randomState;
+
+	uint64_t _calibrationTicks;
+	std::chrono::steady_clock::time_point _calibrationTime;
+
+	Profiler()
+		:_nextThreadId(0)
+		,_captureTrace(false)
+		,_maxTraceEvents(0)
+		,_dropped(0)
+		,_randomState(0x9E3779B97F4A7C15ULL)
+		,_calibrationTicks(now())
+		,_calibrationTime(std::chrono::steady_clock::now())
+	{
+	}
+
+	~Profiler()
+	{
+		for (size_t i = 0; i < _threads.size(); i++)
+		{
+			_threads[i]->~ThreadBuffer();
+			::operator delete(_threadMemory[i]);
+		}
+	}
+
+	// hands the thread's buffer back to the profiler when the thread exits
+	struct ThreadRegistration
+	{
+		ThreadBuffer * buffer;
+
+		~ThreadRegistration()
+		{
+			if (buffer != nullptr)
+				instance().releaseThread(buffer);
+		}
+	};
+
+	static ThreadBuffer * threadBuffer()
+	{
+		static thread_local ThreadRegistration registration = { nullptr };
+		if (registration.buffer == nullptr)
+			registration.buffer = instance().registerThread();
+		return registration.buffer;
+	}
+
+	// reuses the buffer of a thread that has exited if there is one, so short-lived threads
+	// don't each leave a ring behind
+	ThreadBuffer * registerThread()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		ThreadBuffer * buffer;
+		if (!_freeThreads.empty())
+		{
+			buffer = _freeThreads.back();
+			_freeThreads.pop_back();
+		}
+		else
+		{
+			// the ring is cache-line aligned, which plain new does not guarantee before C++17
+			void * memory = ::operator new(sizeof(ThreadBuffer) + RingBufferCacheLineSize);
+			const uintptr_t aligned = ((uintptr_t)memory + RingBufferCacheLineSize - 1) & ~(uintptr_t)(RingBufferCacheLineSize - 1);
+			buffer = new ((void *)aligned) ThreadBuffer();
+			buffer->dropped.store(0, std::memory_order_relaxed);
+			_threads.push_back(buffer);
+			_threadMemory.push_back(memory);
+		}
+		buffer->threadId = _nextThreadId++;
+		return buffer;
+	}
+
+	// the exiting thread's last events are collected now, as its buffer is about to be reused
+	void releaseThread(ThreadBuffer * buffer)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		drain(*buffer);
+		_freeThreads.push_back(buffer);
+	}
+
+	void drain(ThreadBuffer & buffer)
+	{
+		ProfileEvent events[256];
+		_dropped += buffer.dropped.exchange(0, std::memory_order_relaxed);
+		for (size_t count = buffer.events.pop(events, 256); count > 0; count = buffer.events.pop(events, 256))
+		{
+			for (size_t e = 0; e < count; e++)
+				add(events[e], buffer.threadId);
+		}
+	}
+
+	void add(const ProfileEvent & event, unsigned int threadId)
+	{
+		const uint64_t ticks = event.end > event.start ? event.end - event.start : 0;
+		ScopeData & data = _scopes[event.name];
+		data.count++;
+		data.totalTicks += ticks;
+		data.maxTicks = std::max(data.maxTicks, ticks);
+
+		if (data.samples.size() < ReservoirSize)
+			data.samples.push_back(ticks);
+		else
+		{
+			const uint64_t slot = nextRandom() % data.count;
+			if (slot < ReservoirSize)
+				data.samples[(size_t)slot] = ticks;
+		}
+
+		if (_captureTrace && _trace.size() < _maxTraceEvents)
+		{
+			const TraceEvent trace = { event, threadId };
+			_trace.push_back(trace);
+		}
+	}
+
+	uint64_t nextRandom()
+	{
+		_randomState ^= _randomState << 13;
+		_randomState ^= _randomState >> 7;
+		_randomState ^= _randomState << 17;
+		return _randomState;
+	}
+
+	// nanoseconds per tick, measured against steady_clock since the profiler was created.
+	// Only reads members that are fixed at construction, so it needs no lock
+	double calibrate() const
+	{
+#if defined(PROFILER_USE_RDTSC)
+		std::chrono::steady_clock::time_point time = std::chrono::steady_clock::now();
+		while (time - _calibrationTime < std::chrono::milliseconds(10))
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			time = std::chrono::steady_clock::now();
+		}
+		const uint64_t ticks = now() - _calibrationTicks;
+		const double nanoseconds = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(time - _calibrationTime).count();
+		return ticks > 0 ? nanoseconds / double(ticks) : 1.0;
+#else
+		return 1.0;
+#endif
+	}
+};
+
+class ProfileScope
+{
+public:
+	explicit ProfileScope(const char * name)
+		:_name(name)
+		,_start(Profiler::now())
+	{
+	}
+
+	~ProfileScope()
+	{
+		Profiler::record(_name, _start, Profiler::now());
+	}
+
+	ProfileScope(const ProfileScope &) = delete;
+	ProfileScope & operator = (const ProfileScope &) = delete;
+
+private:
+	const char * _name;
+	uint64_t _start;
+};
+
+#define PROFILE_SCOPE_CONCAT_INNER(a, b) a##b
+#define PROFILE_SCOPE_CONCAT(a, b) PROFILE_SCOPE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_SCOPE_CONCAT(_profileScope, __LINE__)(name)
+
+#endif
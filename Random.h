@@ -32,63 +32,1041 @@ For more information, please refer to <http://unlicense.org/>
  */
 
 #include <random>
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+#include <cstddef>
+#include <cmath>
+#include <limits>
 
-template<typename T>
+#if !defined(RANDOM_NO_SIMD) && defined(__AVX2__)
+#include <immintrin.h>
+#define RANDOM_LANES_AVX2
+#elif !defined(RANDOM_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#include <emmintrin.h>
+#define RANDOM_LANES_SSE2
+#endif
+
+/*
+ Engines. All of them satisfy UniformRandomBitGenerator, so they also work with the std::
+ distributions, and additionally provide next32()/next64() for the distributions below.
+
+   SplitMix64          8 bytes of state, very fast, mainly used to seed the others
+   Xoshiro256StarStar 32 bytes of state, the default
+   PCG32              16 bytes of state, 32-bit output
+   Philox4x32         counter-based, any sample of any stream can be computed directly
+
+ For deterministic parallel work either give each task its own Philox4x32 stream, or hand
+ out split() copies of a sequential engine; both give the same results whatever the
+ number of threads or the order they run in.
+ */
+
+class SplitMix64
+{
+public:
+	typedef uint64_t result_type;
+
+	explicit SplitMix64(uint64_t seed = 0) : _state(seed) {}
+
+	void seed(uint64_t seed) { _state = seed; }
+
+	inline uint64_t next64()
+	{
+		uint64_t z = (_state += 0x9E3779B97F4A7C15ULL);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		return z ^ (z >> 31);
+	}
+
+	inline uint32_t next32() { return uint32_t(next64() >> 32); }
+	inline result_type operator()() { return next64(); }
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return ~result_type(0); }
+
+	// skips delta outputs
+	void advance(uint64_t delta) { _state += delta * 0x9E3779B97F4A7C15ULL; }
+
+	// a generator seeded from this one's next output
+	SplitMix64 split() { return SplitMix64(next64()); }
+
+private:
+	uint64_t _state;
+};
+
+class Xoshiro256StarStar
+{
+public:
+	typedef uint64_t result_type;
+
+	explicit Xoshiro256StarStar(uint64_t seed = 0) { this->seed(seed); }
+
+	// expands the seed with SplitMix64, as recommended by the xoshiro authors
+	void seed(uint64_t seed)
+	{
+		SplitMix64 seeder(seed);
+		for (int i = 0; i < 4; i++)
+			_state[i] = seeder.next64();
+	}
+
+	inline uint64_t next64()
+	{
+		const uint64_t result = rotl(_state[1] * 5, 7) * 9;
+		const uint64_t t = _state[1] << 17;
+		_state[2] ^= _state[0];
+		_state[3] ^= _state[1];
+		_state[1] ^= _state[2];
+		_state[0] ^= _state[3];
+		_state[2] ^= t;
+		_state[3] = rotl(_state[3], 45);
+		return result;
+	}
+
+	inline uint32_t next32() { return uint32_t(next64() >> 32); }
+	inline result_type operator()() { return next64(); }
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return ~result_type(0); }
+
+	// skips 2^128 outputs
+	void jump()
+	{
+		static const uint64_t polynomial[4] = { 0x180EC6D33CFD0ABAULL, 0xD5A61266F0C9392CULL, 0xA9582618E03FC9AAULL, 0x39ABDC4529B1661CULL };
+		jump(polynomial);
+	}
+
+	// skips 2^192 outputs
+	void longJump()
+	{
+		static const uint64_t polynomial[4] = { 0x76E15D3EFEFDCBBFULL, 0xC5004E441C522FB3ULL, 0x77710069854EE241ULL, 0x39109BB02ACBE635ULL };
+		jump(polynomial);
+	}
+
+	// Returns a generator that continues this sequence and moves this one 2^128 outputs
+	// ahead, so repeated splits hand out non-overlapping streams.
+	Xoshiro256StarStar split()
+	{
+		Xoshiro256StarStar child(*this);
+		jump();
+		return child;
+	}
+
+protected:
+	uint64_t _state[4];
+
+	void jump(const uint64_t polynomial[4])
+	{
+		uint64_t jumped[4] = { 0, 0, 0, 0 };
+		for (int i = 0; i < 4; i++)
+		{
+			for (int bit = 0; bit < 64; bit++)
+			{
+				if (polynomial[i] & (uint64_t(1) << bit))
+				{
+					for (int j = 0; j < 4; j++)
+						jumped[j] ^= _state[j];
+				}
+				next64();
+			}
+		}
+
+		for (int j = 0; j < 4; j++)
+			_state[j] = jumped[j];
+	}
+
+	static inline uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+};
+
+class PCG32
+{
+public:
+	typedef uint32_t result_type;
+
+	explicit PCG32(uint64_t seed = 0, uint64_t stream = 0x14057B7EF767814FULL) { this->seed(seed, stream); }
+
+	void seed(uint64_t seed, uint64_t stream = 0x14057B7EF767814FULL)
+	{
+		_state = 0;
+		_increment = (stream << 1) | 1;
+		next32();
+		_state += seed;
+		next32();
+	}
+
+	inline uint32_t next32()
+	{
+		const uint64_t old = _state;
+		_state = old * Multiplier + _increment;
+		const uint32_t xorShifted = uint32_t(((old >> 18) ^ old) >> 27);
+		const uint32_t rotation = uint32_t(old >> 59);
+		return (xorShifted >> rotation) | (xorShifted << ((32 - rotation) & 31));
+	}
+
+	inline uint64_t next64()
+	{
+		const uint64_t high = next32();
+		return (high << 32) | next32();
+	}
+
+	inline result_type operator()() { return next32(); }
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return ~result_type(0); }
+
+	// skips delta outputs in O(log delta) (Brown, "Random number generation with arbitrary strides")
+	void advance(uint64_t delta)
+	{
+		uint64_t multiplier = Multiplier;
+		uint64_t increment = _increment;
+		uint64_t accumulatedMultiplier = 1;
+		uint64_t accumulatedIncrement = 0;
+		while (delta > 0)
+		{
+			if (delta & 1)
+			{
+				accumulatedMultiplier *= multiplier;
+				accumulatedIncrement = accumulatedIncrement * multiplier + increment;
+			}
+			increment = (multiplier + 1) * increment;
+			multiplier *= multiplier;
+			delta >>= 1;
+		}
+		_state = accumulatedMultiplier * _state + accumulatedIncrement;
+	}
+
+	// Returns a generator that continues this sequence and moves this one 2^48 outputs
+	// ahead; the period of 2^64 leaves room for 65536 non-overlapping splits.
+	PCG32 split()
+	{
+		PCG32 child(*this);
+		advance(uint64_t(1) << 48);
+		return child;
+	}
+
+protected:
+	static const uint64_t Multiplier = 6364136223846793005ULL;
+	uint64_t _state;
+	uint64_t _increment;
+};
+
+/*
+ Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3"). Output is a
+ pure function of (key, stream, index): block n of a stream is ten rounds of a bijection
+ applied to the 128-bit counter {n, stream}, giving four 32-bit outputs. seekTo() and the
+ static sample functions reach any position in constant time, so work items can draw
+ "their" numbers without any shared state.
+ */
+class Philox4x32
+{
+public:
+	typedef uint32_t result_type;
+
+	explicit Philox4x32(uint64_t seed = 0, uint64_t stream = 0)
+		: _stream(stream)
+		, _position(0)
+	{
+		this->seed(seed);
+	}
+
+	// the key; keeps the current stream and position
+	void seed(uint64_t seed)
+	{
+		_key[0] = uint32_t(seed);
+		_key[1] = uint32_t(seed >> 32);
+		refill();
+	}
+
+	// index counts 32-bit outputs
+	void seekTo(uint64_t stream, uint64_t index)
+	{
+		_stream = stream;
+		_position = index;
+		refill();
+	}
+
+	uint64_t stream() const { return _stream; }
+	uint64_t position() const { return _position; }
+
+	inline uint32_t next32()
+	{
+		const uint32_t value = _block[_position & 3];
+		if ((++_position & 3) == 0)
+			refill();
+		return value;
+	}
+
+	inline uint64_t next64()
+	{
+		const uint64_t high = next32();
+		return (high << 32) | next32();
+	}
+
+	inline result_type operator()() { return next32(); }
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return ~result_type(0); }
+
+	// output index of the given stream, the same value next32() returns there
+	static uint32_t sample32(uint64_t seed, uint64_t stream, uint64_t index)
+	{
+		uint32_t block[4];
+		generateBlock(seed, stream, index >> 2, block);
+		return block[index & 3];
+	}
+
+	// the same value next64() returns when positioned at output 2 * index
+	static uint64_t sample64(uint64_t seed, uint64_t stream, uint64_t index)
+	{
+		uint32_t block[4];
+		generateBlock(seed, stream, index >> 1, block);
+		const int first = int(index & 1) * 2;
+		return (uint64_t(block[first]) << 32) | block[first + 1];
+	}
+
+	static void generateBlock(uint64_t seed, uint64_t stream, uint64_t blockIndex, uint32_t block[4])
+	{
+		uint32_t key[2] = { uint32_t(seed), uint32_t(seed >> 32) };
+		block[0] = uint32_t(blockIndex);
+		block[1] = uint32_t(blockIndex >> 32);
+		block[2] = uint32_t(stream);
+		block[3] = uint32_t(stream >> 32);
+
+		for (int round = 0; round < 10; round++)
+		{
+			if (round > 0)
+			{
+				key[0] += 0x9E3779B9u;
+				key[1] += 0xBB67AE85u;
+			}
+
+			const uint64_t product0 = uint64_t(0xD2511F53u) * block[0];
+			const uint64_t product1 = uint64_t(0xCD9E8D57u) * block[2];
+			const uint32_t counter1 = block[1];
+			const uint32_t counter3 = block[3];
+			block[0] = uint32_t(product1 >> 32) ^ counter1 ^ key[0];
+			block[1] = uint32_t(product1);
+			block[2] = uint32_t(product0 >> 32) ^ counter3 ^ key[1];
+			block[3] = uint32_t(product0);
+		}
+	}
+
+private:
+	uint32_t _key[2];
+	uint64_t _stream;
+	uint64_t _position;
+	// the block _position is in
+	uint32_t _block[4];
+
+	void refill()
+	{
+		generateBlock((uint64_t(_key[1]) << 32) | _key[0], _stream, _position >> 2, _block);
+	}
+};
+
+/*
+ Four independent xoshiro256** generators stepped together, for the fill() bulk APIs.
+ The AVX2 path runs all four lanes in one register, the SSE2 path in two; without either
+ (or with RANDOM_NO_SIMD defined) the same lanes are stepped one by one. All three paths
+ produce exactly the same output, interleaved as lane 0, 1, 2, 3, lane 0, 1, ...
+
+ The multiplications by 5 and 9 are done as shift-and-add, since there is no 64-bit
+ vector multiply before AVX-512.
+ */
+class Xoshiro256StarStarLanes
+{
+public:
+	static const size_t Lanes = 4;
+
+	explicit Xoshiro256StarStarLanes(uint64_t seed)
+	{
+		SplitMix64 seeder(seed);
+		for (size_t lane = 0; lane < Lanes; lane++)
+			for (int i = 0; i < 4; i++)
+				_state[i][lane] = seeder.next64();
+	}
+
+	// count must be a multiple of Lanes
+	void generate(uint64_t * values, size_t count)
+	{
+#if defined(RANDOM_LANES_AVX2)
+		__m256i s0 = _mm256_load_si256((const __m256i*)_state[0]);
+		__m256i s1 = _mm256_load_si256((const __m256i*)_state[1]);
+		__m256i s2 = _mm256_load_si256((const __m256i*)_state[2]);
+		__m256i s3 = _mm256_load_si256((const __m256i*)_state[3]);
+		for (size_t i = 0; i < count; i += Lanes)
+		{
+			const __m256i times5 = _mm256_add_epi64(_mm256_slli_epi64(s1, 2), s1);
+			const __m256i rotated = _mm256_or_si256(_mm256_slli_epi64(times5, 7), _mm256_srli_epi64(times5, 57));
+			_mm256_storeu_si256((__m256i*)(values + i), _mm256_add_epi64(_mm256_slli_epi64(rotated, 3), rotated));
+
+			const __m256i t = _mm256_slli_epi64(s1, 17);
+			s2 = _mm256_xor_si256(s2, s0);
+			s3 = _mm256_xor_si256(s3, s1);
+			s1 = _mm256_xor_si256(s1, s2);
+			s0 = _mm256_xor_si256(s0, s3);
+			s2 = _mm256_xor_si256(s2, t);
+			s3 = _mm256_or_si256(_mm256_slli_epi64(s3, 45), _mm256_srli_epi64(s3, 19));
+		}
+		_mm256_store_si256((__m256i*)_state[0], s0);
+		_mm256_store_si256((__m256i*)_state[1], s1);
+		_mm256_store_si256((__m256i*)_state[2], s2);
+		_mm256_store_si256((__m256i*)_state[3], s3);
+#elif defined(RANDOM_LANES_SSE2)
+		for (size_t half = 0; half < Lanes; half += 2)
+		{
+			__m128i s0 = _mm_load_si128((const __m128i*)(_state[0] + half));
+			__m128i s1 = _mm_load_si128((const __m128i*)(_state[1] + half));
+			__m128i s2 = _mm_load_si128((const __m128i*)(_state[2] + half));
+			__m128i s3 = _mm_load_si128((const __m128i*)(_state[3] + half));
+			for (size_t i = 0; i < count; i += Lanes)
+			{
+				const __m128i times5 = _mm_add_epi64(_mm_slli_epi64(s1, 2), s1);
+				const __m128i rotated = _mm_or_si128(_mm_slli_epi64(times5, 7), _mm_srli_epi64(times5, 57));
+				_mm_storeu_si128((__m128i*)(values + i + half), _mm_add_epi64(_mm_slli_epi64(rotated, 3), rotated));
+
+				const __m128i t = _mm_slli_epi64(s1, 17);
+				s2 = _mm_xor_si128(s2, s0);
+				s3 = _mm_xor_si128(s3, s1);
+				s1 = _mm_xor_si128(s1, s2);
+				s0 = _mm_xor_si128(s0, s3);
+				s2 = _mm_xor_si128(s2, t);
+				s3 = _mm_or_si128(_mm_slli_epi64(s3, 45), _mm_srli_epi64(s3, 19));
+			}
+			_mm_store_si128((__m128i*)(_state[0] + half), s0);
+			_mm_store_si128((__m128i*)(_state[1] + half), s1);
+			_mm_store_si128((__m128i*)(_state[2] + half), s2);
+			_mm_store_si128((__m128i*)(_state[3] + half), s3);
+		}
+#else
+		for (size_t i = 0; i < count; i += Lanes)
+		{
+			for (size_t lane = 0; lane < Lanes; lane++)
+			{
+				const uint64_t s1 = _state[1][lane];
+				const uint64_t times5 = (s1 << 2) + s1;
+				const uint64_t rotated = (times5 << 7) | (times5 >> 57);
+				values[i + lane] = (rotated << 3) + rotated;
+
+				const uint64_t t = s1 << 17;
+				_state[2][lane] ^= _state[0][lane];
+				_state[3][lane] ^= _state[1][lane];
+				_state[1][lane] ^= _state[2][lane];
+				_state[0][lane] ^= _state[3][lane];
+				_state[2][lane] ^= t;
+				_state[3][lane] = (_state[3][lane] << 45) | (_state[3][lane] >> 19);
+			}
+		}
+#endif
+	}
+
+private:
+	alignas(32) uint64_t _state[4][Lanes];
+};
+
+// Seeds for instances constructed without an explicit seed. std::random_device is read
+// once per process; every call after that is a SplitMix64 step on an atomic counter.
+class RandomSeed
+{
+public:
+	static uint64_t next()
+	{
+		static std::atomic<uint64_t> counter(initialSeed());
+		SplitMix64 mix(counter.fetch_add(0x9E3779B97F4A7C15ULL, std::memory_order_relaxed));
+		return mix.next64();
+	}
+
+private:
+	static uint64_t initialSeed()
+	{
+		std::random_device device;
+		return (uint64_t(device()) << 32) ^ uint64_t(device());
+	}
+};
+
+// conversions from raw engine output, without rejection loops
+class RandomBits
+{
+public:
+	// [0, 1) with 24 bits of precision
+	static inline float toUnitFloat(uint32_t bits) { return float(int32_t(bits >> 8)) * (1.0f / 16777216.0f); }
+	// [0, 1) with 53 bits of precision
+	static inline double toUnitDouble(uint64_t bits) { return double(int64_t(bits >> 11)) * (1.0 / 9007199254740992.0); }
+	// (0, 1) with 53 bits of precision, safe to take the logarithm of
+	static inline double toOpenUnitDouble(uint64_t bits) { return (double(int64_t(bits >> 11)) + 0.5) * (1.0 / 9007199254740992.0); }
+	// [0, range) by multiply-shift. Biased by at most range / 2^32, which is negligible for small ranges.
+	static inline uint32_t toRange(uint32_t bits, uint64_t range) { return uint32_t((uint64_t(bits) * range) >> 32); }
+};
+
+/*
+ exp and log for the non-uniform distributions. The C library versions may differ in the
+ last bit between platforms, which would change which samples a rejection step accepts;
+ these only use +, -, *, / and exact scaling, so they give the same result everywhere
+ (given the same floating point contraction setting, see UniformDistribution::fill).
+ Accurate to a few ulp, which is all the distributions need.
+ */
+class RandomMath
+{
+public:
+	static double exp(double x)
+	{
+		if (x > 709.0)
+			return std::numeric_limits<double>::infinity();
+		if (x < -745.0)
+			return 0.0;
+
+		// x = k ln2 + r with |r| <= ln2 / 2, then a Taylor series for exp(r)
+		const double k = std::floor(x * 1.4426950408889634 + 0.5);
+		const double r = (x - k * 6.93147180369123816490e-01) - k * 1.90821492927058770002e-10;
+		double sum = 1.0;
+		for (int n = 17; n > 0; n--)
+			sum = 1.0 + sum * r / double(n);
+		return std::ldexp(sum, int(k));
+	}
+
+	static double log(double x)
+	{
+		if (!(x > 0.0))
+			return x == 0.0 ? -std::numeric_limits<double>::infinity() : std::numeric_limits<double>::quiet_NaN();
+
+		// x = m 2^e with m in [sqrt(1/2), sqrt(2)), then log(m) = 2 atanh((m - 1) / (m + 1))
+		int e = 0;
+		double m = std::frexp(x, &e);
+		if (m < 0.70710678118654752440)
+		{
+			m *= 2.0;
+			e--;
+		}
+
+		const double s = (m - 1.0) / (m + 1.0);
+		const double s2 = s * s;
+		double sum = 1.0 / 23.0;
+		for (int n = 21; n > 0; n -= 2)
+			sum = 1.0 / double(n) + sum * s2;
+		return double(e) * 6.93147180369123816490e-01 + (2.0 * s * sum + double(e) * 1.90821492927058770002e-10);
+	}
+
+	// log(k!)
+	static double logFactorial(unsigned int k)
+	{
+		static const LogFactorialTable table;
+		if (k < LogFactorialTable::Size)
+			return table.values[k];
+
+		// Stirling series for log(gamma(k + 1))
+		const double x = double(k) + 1.0;
+		const double inverse = 1.0 / x;
+		const double inverse2 = inverse * inverse;
+		return (x - 0.5) * log(x) - x + 0.91893853320467274178 + inverse * (1.0 / 12.0 - inverse2 * (1.0 / 360.0 - inverse2 * (1.0 / 1260.0)));
+	}
+
+private:
+	struct LogFactorialTable
+	{
+		static const unsigned int Size = 256;
+		double values[Size];
+
+		LogFactorialTable()
+		{
+			values[0] = 0.0;
+			for (unsigned int k = 1; k < Size; k++)
+				values[k] = values[k - 1] + log(double(k));
+		}
+	};
+};
+
+/*
+ Tables for the Marsaglia-Tsang ziggurat ("The Ziggurat Method for Generating Random
+ Variables", 2000): 128 layers for the normal, 256 for the exponential distribution. Built
+ once per process with RandomMath, so they are identical everywhere.
+ */
+struct ZigguratTables
+{
+	uint32_t k[256];
+	double w[256];
+	double f[256];
+
+	static const ZigguratTables & normal()
+	{
+		static const ZigguratTables tables(true);
+		return tables;
+	}
+
+	static const ZigguratTables & exponential()
+	{
+		static const ZigguratTables tables(false);
+		return tables;
+	}
+
+	// where the base layers' tails start
+	static double normalTail() { return 3.442619855899; }
+	static double exponentialTail() { return 7.697117470131487; }
+
+private:
+	explicit ZigguratTables(bool isNormal)
+	{
+		if (isNormal)
+		{
+			const double scale = 2147483648.0;
+			const double area = 9.91256303526217e-3;
+			double x = normalTail();
+			double previous = x;
+			const double q = area / RandomMath::exp(-0.5 * x * x);
+			k[0] = uint32_t((x / q) * scale);
+			k[1] = 0;
+			w[0] = q / scale;
+			w[127] = x / scale;
+			f[0] = 1.0;
+			f[127] = RandomMath::exp(-0.5 * x * x);
+			for (int i = 126; i >= 1; i--)
+			{
+				x = std::sqrt(-2.0 * RandomMath::log(area / x + RandomMath::exp(-0.5 * x * x)));
+				k[i + 1] = uint32_t((x / previous) * scale);
+				previous = x;
+				f[i] = RandomMath::exp(-0.5 * x * x);
+				w[i] = x / scale;
+			}
+		}
+		else
+		{
+			const double scale = 4294967296.0;
+			const double area = 3.949659822581572e-3;
+			double x = exponentialTail();
+			double previous = x;
+			const double q = area / RandomMath::exp(-x);
+			k[0] = uint32_t((x / q) * scale);
+			k[1] = 0;
+			w[0] = q / scale;
+			w[255] = x / scale;
+			f[0] = 1.0;
+			f[255] = RandomMath::exp(-x);
+			for (int i = 254; i >= 1; i--)
+			{
+				x = -RandomMath::log(area / x + RandomMath::exp(-x));
+				k[i + 1] = uint32_t((x / previous) * scale);
+				previous = x;
+				f[i] = RandomMath::exp(-x);
+				w[i] = x / scale;
+			}
+		}
+	}
+};
+
+
+template<typename T, typename Engine = Xoshiro256StarStar>
 class Random
 {
 public:
-	Random(T lowerLimit, T upperLimit)
-		: _seed{}
-		, _numberGenerator(_seed())
+	// the limits are kept by the distributions deriving from this
+	Random(T /*lowerLimit*/, T /*upperLimit*/)
+		: _numberGenerator(RandomSeed::next())
 	{
 
 	}
 
+	// the same seed always gives the same sequence
+	Random(T /*lowerLimit*/, T /*upperLimit*/, uint64_t seed)
+		: _numberGenerator(seed)
+	{
+
+	}
+
+	void seed(uint64_t seed) { _numberGenerator.seed(seed); }
+	Engine & engine() { return _numberGenerator; }
+
 protected:
-	std::random_device _seed;
-	std::mt19937 _numberGenerator;
+	Engine _numberGenerator;
 };
 
-template<typename T>
-class UniformDistribution : public Random<T>
+// values in [lowerLimit, upperLimit)
+template<typename T, typename Engine = Xoshiro256StarStar>
+class UniformDistribution : public Random<T, Engine>
 {
 public:
 	UniformDistribution(T lowerLimit, T upperLimit)
-		:Random<T>(lowerLimit, upperLimit)
-		,_distribution(float(lowerLimit), float(upperLimit))
+		:Random<T, Engine>(lowerLimit, upperLimit)
+		,_lowerLimit(Real(lowerLimit))
+		,_range(Real(upperLimit) - Real(lowerLimit))
+	{
+	}
+
+	UniformDistribution(T lowerLimit, T upperLimit, uint64_t seed)
+		:Random<T, Engine>(lowerLimit, upperLimit, seed)
+		,_lowerLimit(Real(lowerLimit))
+		,_range(Real(upperLimit) - Real(lowerLimit))
 	{
 	}
 
 	T generate()
 	{
-		const float t = _distribution(Random<T>::_numberGenerator);
+		const Real t = _lowerLimit + _range * unit();
 		return T(t);
 	}
 
+	/*
+	 Fills values with count samples, several generator lanes at a time. The lanes are
+	 seeded from one draw of engine(), so the output depends only on the seed and the call
+	 sequence, not on the instruction set, but it is not the same sequence generate() gives.
+	 Bit-identical results across machines also need the same floating point contraction
+	 setting: a compiler that fuses lower + range * u into an FMA (-ffp-contract=fast, the
+	 GCC default for non-ISO modes when FMA is enabled) rounds once instead of twice.
+	 */
+	void fill(T * values, size_t count)
+	{
+		Xoshiro256StarStarLanes lanes(Random<T, Engine>::_numberGenerator.next64());
+		uint64_t bits[FillBlock];
+		while (count > 0)
+		{
+			const size_t block = count < FillBlock ? count : FillBlock;
+			lanes.generate(bits, (block + Xoshiro256StarStarLanes::Lanes - 1) & ~(Xoshiro256StarStarLanes::Lanes - 1));
+			for (size_t i = 0; i < block; i++)
+				values[i] = T(_lowerLimit + _range * unit(bits[i]));
+
+			values += block;
+			count -= block;
+		}
+	}
+
 private:
-	std::uniform_real_distribution<float> _distribution;
+	// double only when double is asked for, float otherwise as before
+	typedef typename std::conditional<std::is_same<T, double>::value, double, float>::type Real;
+
+	Real _lowerLimit;
+	Real _range;
+
+	static const size_t FillBlock = 256;
+
+	inline Real unit()
+	{
+		return std::is_same<Real, double>::value ? Real(RandomBits::toUnitDouble(Random<T, Engine>::_numberGenerator.next64())) : Real(RandomBits::toUnitFloat(Random<T, Engine>::_numberGenerator.next32()));
+	}
+
+	static inline Real unit(uint64_t bits)
+	{
+		return std::is_same<Real, double>::value ? Real(RandomBits::toUnitDouble(bits)) : Real(RandomBits::toUnitFloat(uint32_t(bits >> 32)));
+	}
 };
 
-template<>
-class UniformDistribution<unsigned int> : public Random<unsigned int>
+// values in [lowerLimit, upperLimit], both inclusive
+template<typename Engine>
+class UniformDistribution<unsigned int, Engine> : public Random<unsigned int, Engine>
 {
 public:
     UniformDistribution(unsigned int lowerLimit, unsigned int upperLimit)
-    :Random<unsigned int>(lowerLimit, upperLimit)
-    ,_distribution(lowerLimit, upperLimit)
+    :Random<unsigned int, Engine>(lowerLimit, upperLimit)
+    ,_lowerLimit(lowerLimit)
+    ,_range(uint64_t(upperLimit) - uint64_t(lowerLimit) + 1)
     {
     }
     
+    UniformDistribution(unsigned int lowerLimit, unsigned int upperLimit, uint64_t seed)
+    :Random<unsigned int, Engine>(lowerLimit, upperLimit, seed)
+    ,_lowerLimit(lowerLimit)
+    ,_range(uint64_t(upperLimit) - uint64_t(lowerLimit) + 1)
+    {
+    }
+    
+    // multiply-shift, no rejection; see RandomBits::toRange for the bias
     unsigned int generate()
     {
-        const unsigned int t = _distribution(Random<unsigned int>::_numberGenerator);
-        return t;
+        return _lowerLimit + RandomBits::toRange(Random<unsigned int, Engine>::_numberGenerator.next32(), _range);
+    }
+    
+    // exactly uniform (Lemire's method), at the cost of an occasional retry
+    unsigned int generateUnbiased()
+    {
+        uint64_t product = uint64_t(Random<unsigned int, Engine>::_numberGenerator.next32()) * _range;
+        uint32_t low = uint32_t(product);
+        if (low < _range)
+        {
+            const uint32_t threshold = uint32_t((0x100000000ULL - _range) % _range);
+            while (low < threshold)
+            {
+                product = uint64_t(Random<unsigned int, Engine>::_numberGenerator.next32()) * _range;
+                low = uint32_t(product);
+            }
+        }
+        return _lowerLimit + uint32_t(product >> 32);
+    }
+    
+    // bulk version of generate(), see the generic UniformDistribution::fill()
+    void fill(unsigned int * values, size_t count)
+    {
+        Xoshiro256StarStarLanes lanes(Random<unsigned int, Engine>::_numberGenerator.next64());
+        uint64_t bits[FillBlock];
+        while (count > 0)
+        {
+            const size_t block = count < FillBlock ? count : FillBlock;
+            lanes.generate(bits, (block + Xoshiro256StarStarLanes::Lanes - 1) & ~(Xoshiro256StarStarLanes::Lanes - 1));
+            for (size_t i = 0; i < block; i++)
+                values[i] = _lowerLimit + RandomBits::toRange(uint32_t(bits[i] >> 32), _range);
+            
+            values += block;
+            count -= block;
+        }
     }
     
 private:
-    std::uniform_int_distribution<unsigned int> _distribution;
+    static const size_t FillBlock = 256;
+
+    unsigned int _lowerLimit;
+    uint64_t _range;
 
 };
 
-#endif
+// normally distributed values. Draws one 64-bit engine output per sample over 98% of the time.
+template<typename T, typename Engine = Xoshiro256StarStar>
+class NormalDistribution : public Random<T, Engine>
+{
+public:
+	NormalDistribution(T mean, T standardDeviation)
+		:Random<T, Engine>(mean, standardDeviation)
+		,_mean(mean)
+		,_standardDeviation(standardDeviation)
+		,_tables(ZigguratTables::normal())
+	{
+	}
+
+	NormalDistribution(T mean, T standardDeviation, uint64_t seed)
+		:Random<T, Engine>(mean, standardDeviation, seed)
+		,_mean(mean)
+		,_standardDeviation(standardDeviation)
+		,_tables(ZigguratTables::normal())
+	{
+	}
+
+	T generate()
+	{
+		return T(double(_mean) + double(_standardDeviation) * standardNormal());
+	}
+
+private:
+	T _mean;
+	T _standardDeviation;
+	const ZigguratTables & _tables;
+
+	double uniform() { return RandomBits::toOpenUnitDouble(Random<T, Engine>::_numberGenerator.next64()); }
+
+	double standardNormal()
+	{
+		for (;;)
+		{
+			// layer from the low bits, signed position from the high bits
+			const uint64_t bits = Random<T, Engine>::_numberGenerator.next64();
+			const int layer = int(bits & 127);
+			const int32_t position = int32_t(uint32_t(bits >> 32));
+			const double x = double(position) * _tables.w[layer];
+			const uint32_t magnitude = position < 0 ? uint32_t(0) - uint32_t(position) : uint32_t(position);
+			if (magnitude < _tables.k[layer])
+				return x;
+
+			if (layer == 0)
+			{
+				// the tail beyond normalTail()
+				double tail = 0.0;
+				double y = 0.0;
+				do
+				{
+					tail = -RandomMath::log(uniform()) / ZigguratTables::normalTail();
+					y = -RandomMath::log(uniform());
+				} while (y + y < tail * tail);
+				return position > 0 ? ZigguratTables::normalTail() + tail : -ZigguratTables::normalTail() - tail;
+			}
 
+			if (_tables.f[layer] + uniform() * (_tables.f[layer - 1] - _tables.f[layer]) < RandomMath::exp(-0.5 * x * x))
+				return x;
+		}
+	}
+};
+
+// exponentially distributed values with the given rate (mean 1 / rate)
+template<typename T, typename Engine = Xoshiro256StarStar>
+class ExponentialDistribution : public Random<T, Engine>
+{
+public:
+	ExponentialDistribution(T rate)
+		:Random<T, Engine>(T(0), rate)
+		,_mean(1.0 / double(rate))
+		,_tables(ZigguratTables::exponential())
+	{
+	}
+
+	ExponentialDistribution(T rate, uint64_t seed)
+		:Random<T, Engine>(T(0), rate, seed)
+		,_mean(1.0 / double(rate))
+		,_tables(ZigguratTables::exponential())
+	{
+	}
+
+	T generate()
+	{
+		return T(_mean * standardExponential());
+	}
+
+private:
+	double _mean;
+	const ZigguratTables & _tables;
+
+	double uniform() { return RandomBits::toOpenUnitDouble(Random<T, Engine>::_numberGenerator.next64()); }
+
+	double standardExponential()
+	{
+		for (;;)
+		{
+			const uint64_t bits = Random<T, Engine>::_numberGenerator.next64();
+			const int layer = int(bits & 255);
+			const uint32_t position = uint32_t(bits >> 32);
+			const double x = double(position) * _tables.w[layer];
+			if (position < _tables.k[layer])
+				return x;
+
+			// the tail is exponential again, shifted by exponentialTail()
+			if (layer == 0)
+				return ZigguratTables::exponentialTail() - RandomMath::log(uniform());
+
+			if (_tables.f[layer] + uniform() * (_tables.f[layer - 1] - _tables.f[layer]) < RandomMath::exp(-x))
+				return x;
+		}
+	}
+};
+
+/*
+ Poisson distributed counts. Means below 10 multiply uniforms (Knuth); larger means use
+ Hormann's transformed rejection ("The transformed rejection method for generating Poisson
+ random variables", PTRS, 1993), which takes about 1.1 uniform pairs per sample at any mean.
+ */
+template<typename T = unsigned int, typename Engine = Xoshiro256StarStar>
+class PoissonDistribution : public Random<T, Engine>
+{
+public:
+	PoissonDistribution(double mean)
+		:Random<T, Engine>(T(0), T(0))
+	{
+		setup(mean);
+	}
+
+	PoissonDistribution(double mean, uint64_t seed)
+		:Random<T, Engine>(T(0), T(0), seed)
+	{
+		setup(mean);
+	}
+
+	T generate()
+	{
+		if (_mean < 10.0)
+		{
+			T count = 0;
+			double product = uniform();
+			while (product > _expMinusMean)
+			{
+				count++;
+				product *= uniform();
+			}
+			return count;
+		}
+
+		for (;;)
+		{
+			const double u = uniform() - 0.5;
+			const double v = uniform();
+			const double us = 0.5 - std::fabs(u);
+			const double k = std::floor((2.0 * _a / us + _b) * u + _mean + 0.43);
+			if (us >= 0.07 && v <= _vr)
+				return T(k);
+			if (k < 0.0 || (us < 0.013 && v > us))
+				continue;
+			if (RandomMath::log(v) + _logInverseAlpha - RandomMath::log(_a / (us * us) + _b) <= -_mean + k * _logMean - RandomMath::logFactorial((unsigned int)k))
+				return T(k);
+		}
+	}
+
+private:
+	double _mean;
+	double _expMinusMean;
+	double _logMean;
+	double _a;
+	double _b;
+	double _vr;
+	double _logInverseAlpha;
+
+	double uniform() { return RandomBits::toOpenUnitDouble(Random<T, Engine>::_numberGenerator.next64()); }
+
+	void setup(double mean)
+	{
+		_mean = mean;
+		_expMinusMean = RandomMath::exp(-mean);
+		_logMean = RandomMath::log(mean);
+		const double squareRoot = std::sqrt(mean);
+		_b = 0.931 + 2.53 * squareRoot;
+		_a = -0.059 + 0.02483 * _b;
+		_vr = 0.9277 - 3.6224 / (_b - 2.0);
+		_logInverseAlpha = RandomMath::log(1.1239 + 1.1328 / (_b - 3.4));
+	}
+};
+
+// uniformly distributed points inside the unit disk, by rejection from the enclosing square
+template<typename T, typename Engine = Xoshiro256StarStar>
+class UnitDiskDistribution : public Random<T, Engine>
+{
+public:
+	UnitDiskDistribution()
+		:Random<T, Engine>(T(-1), T(1))
+	{
+	}
+
+	UnitDiskDistribution(uint64_t seed)
+		:Random<T, Engine>(T(-1), T(1), seed)
+	{
+	}
+
+	void generate(T point[2])
+	{
+		double x = 0.0;
+		double y = 0.0;
+		do
+		{
+			x = signedUniform();
+			y = signedUniform();
+		} while (x * x + y * y >= 1.0);
+
+		point[0] = T(x);
+		point[1] = T(y);
+	}
+
+private:
+	double signedUniform() { return 2.0 * RandomBits::toUnitDouble(Random<T, Engine>::_numberGenerator.next64()) - 1.0; }
+};
+
+// uniformly distributed points on the surface of the unit sphere (Marsaglia, 1972)
+template<typename T, typename Engine = Xoshiro256StarStar>
+class UnitSphereDistribution : public Random<T, Engine>
+{
+public:
+	UnitSphereDistribution()
+		:Random<T, Engine>(T(-1), T(1))
+	{
+	}
+
+	UnitSphereDistribution(uint64_t seed)
+		:Random<T, Engine>(T(-1), T(1), seed)
+	{
+	}
+
+	void generate(T point[3])
+	{
+		double u = 0.0;
+		double v = 0.0;
+		double s = 0.0;
+		do
+		{
+			u = signedUniform();
+			v = signedUniform();
+			s = u * u + v * v;
+		} while (s >= 1.0);
+
+		const double scale = 2.0 * std::sqrt(1.0 - s);
+		point[0] = T(u * scale);
+		point[1] = T(v * scale);
+		point[2] = T(1.0 - 2.0 * s);
+	}
+
+private:
+	double signedUniform() { return 2.0 * RandomBits::toUnitDouble(Random<T, Engine>::_numberGenerator.next64()) - 1.0; }
+};
+
+#endif
@@ -0,0 +1,241 @@
+#ifndef _RING_BUFFER_H_
+#define _RING_BUFFER_H_
+
+/*
+LICENSE - this file is public domain
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+
+ */
+
+#include <atomic>
+#include <cstddef>
+
+// Fixed-size lock-free rings for handing data between threads. Like CircularArray the
+// capacity is a template parameter; it must be a power of two so positions wrap with a mask.
+// Instances are cache-line aligned, so allocate them with an allocator that honours alignas
+// (or as globals/members of such objects) to keep producer and consumer state apart.
+
+static const size_t RingBufferCacheLineSize = 64;
+
+// One producer thread, one consumer thread.
+template<int SIZE, typename T>
+class SPSCRingBuffer
+{
+	static_assert(SIZE > 0 && (SIZE & (SIZE - 1)) == 0, "SPSCRingBuffer SIZE must be a power of two");
+
+public:
+	SPSCRingBuffer()
+		:_head(0)
+		,_cachedTail(0)
+		,_tail(0)
+		,_cachedHead(0)
+	{
+	}
+
+	// producer side. Returns false if the ring is full.
+	bool push(const T & value)
+	{
+		const size_t tail = _tail.load(std::memory_order_relaxed);
+		if (tail - _cachedHead == SIZE)
+		{
+			_cachedHead = _head.load(std::memory_order_acquire);
+			if (tail - _cachedHead == SIZE)
+				return false;
+		}
+
+		_values[tail & Mask] = value;
+		_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// producer side. Pushes as many of the values as fit and returns how many that was.
+	size_t push(const T * values, size_t count)
+	{
+		const size_t tail = _tail.load(std::memory_order_relaxed);
+		size_t space = SIZE - (tail - _cachedHead);
+		if (space < count)
+		{
+			_cachedHead = _head.load(std::memory_order_acquire);
+			space = SIZE - (tail - _cachedHead);
+		}
+
+		const size_t pushed = count < space ? count : space;
+		for (size_t i = 0; i < pushed; i++)
+			_values[(tail + i) & Mask] = values[i];
+
+		_tail.store(tail + pushed, std::memory_order_release);
+		return pushed;
+	}
+
+	// consumer side. Returns false if the ring is empty.
+	bool pop(T & value)
+	{
+		const size_t head = _head.load(std::memory_order_relaxed);
+		if (head == _cachedTail)
+		{
+			_cachedTail = _tail.load(std::memory_order_acquire);
+			if (head == _cachedTail)
+				return false;
+		}
+
+		value = _values[head & Mask];
+		_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	// consumer side. Pops up to maxCount values and returns how many were popped.
+	size_t pop(T * values, size_t maxCount)
+	{
+		const size_t head = _head.load(std::memory_order_relaxed);
+		size_t available = _cachedTail - head;
+		if (available < maxCount)
+		{
+			_cachedTail = _tail.load(std::memory_order_acquire);
+			available = _cachedTail - head;
+		}
+
+		const size_t popped = maxCount < available ? maxCount : available;
+		for (size_t i = 0; i < popped; i++)
+			values[i] = _values[(head + i) & Mask];
+
+		_head.store(head + popped, std::memory_order_release);
+		return popped;
+	}
+
+	// only exact when called from the producer or the consumer while the other side is idle
+	size_t size() const { return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire); }
+	bool empty() const { return size() == 0; }
+	static size_t capacity() { return SIZE; }
+
+private:
+	static const size_t Mask = SIZE - 1;
+
+	// consumer owned
+	alignas(RingBufferCacheLineSize) std::atomic<size_t> _head;
+	size_t _cachedTail;
+
+	// producer owned
+	alignas(RingBufferCacheLineSize) std::atomic<size_t> _tail;
+	size_t _cachedHead;
+
+	alignas(RingBufferCacheLineSize) T _values[SIZE];
+};
+
+// Any number of producer threads, one consumer thread. Each slot carries a sequence
+// number (Vyukov's bounded queue), so producers only contend on the tail counter.
+template<int SIZE, typename T>
+class MPSCRingBuffer
+{
+	static_assert(SIZE > 1 && (SIZE & (SIZE - 1)) == 0, "MPSCRingBuffer SIZE must be a power of two");
+
+public:
+	MPSCRingBuffer()
+		:_head(0)
+		,_tail(0)
+	{
+		for (size_t i = 0; i < SIZE; i++)
+			_slots[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	// any thread. Returns false if the ring is full.
+	bool push(const T & value)
+	{
+		size_t tail = _tail.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Slot & slot = _slots[tail & Mask];
+			const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+			const ptrdiff_t difference = ptrdiff_t(sequence) - ptrdiff_t(tail);
+			if (difference == 0)
+			{
+				if (_tail.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed))
+				{
+					slot.value = value;
+					slot.sequence.store(tail + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (difference < 0)
+				return false;
+			else
+				tail = _tail.load(std::memory_order_relaxed);
+		}
+	}
+
+	// any thread. Pushes values in order until the ring is full and returns how many were pushed.
+	size_t push(const T * values, size_t count)
+	{
+		size_t pushed = 0;
+		while (pushed < count && push(values[pushed]))
+			pushed++;
+		return pushed;
+	}
+
+	// consumer side. Returns false if the ring is empty or the next slot is still being written.
+	bool pop(T & value)
+	{
+		const size_t head = _head.load(std::memory_order_relaxed);
+		Slot & slot = _slots[head & Mask];
+		if (slot.sequence.load(std::memory_order_acquire) != head + 1)
+			return false;
+
+		value = slot.value;
+		slot.sequence.store(head + SIZE, std::memory_order_release);
+		_head.store(head + 1, std::memory_order_relaxed);
+		return true;
+	}
+
+	// consumer side. Pops up to maxCount values and returns how many were popped.
+	size_t pop(T * values, size_t maxCount)
+	{
+		size_t popped = 0;
+		while (popped < maxCount && pop(values[popped]))
+			popped++;
+		return popped;
+	}
+
+	static size_t capacity() { return SIZE; }
+
+private:
+	static const size_t Mask = SIZE - 1;
+
+	struct Slot
+	{
+		std::atomic<size_t> sequence;
+		T value;
+	};
+
+	// consumer owned
+	alignas(RingBufferCacheLineSize) std::atomic<size_t> _head;
+
+	// shared by the producers
+	alignas(RingBufferCacheLineSize) std::atomic<size_t> _tail;
+
+	alignas(RingBufferCacheLineSize) Slot _slots[SIZE];
+};
+
+#endif
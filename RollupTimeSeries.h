@@ -0,0 +1,245 @@
+#ifndef _ROLLUP_TIME_SERIES_H_
+#define _ROLLUP_TIME_SERIES_H_
+
+#include <algorithm>
+#include <limits>
+
+/*
+LICENSE - this file is public domain
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+
+ */
+
+// Long-horizon metric history in constant memory. LEVELS rings of BUCKETS buckets each;
+// level 0 buckets span `resolution` time units and every level up is BUCKETS times
+// coarser, so with BUCKETS = 60, LEVELS = 3 and a resolution of 1 second the series keeps
+// the last minute per second, the last hour per minute and the last 60 hours per hour.
+// Every bucket stores sum, min, max and count. addValue() touches one bucket per level.
+template<int BUCKETS, int LEVELS, typename T>
+class RollupTimeSeries
+{
+public:
+    struct Bucket
+    {
+        T sum;
+        T min;
+        T max;
+        long long count;
+
+        T average() const { return count > 0 ? sum / (T)count : T(0); }
+    };
+
+    RollupTimeSeries(double resolution);
+
+    // time is in the same unit as the resolution and should not go backwards by more than one bucket
+    void addValue(double time, T value);
+
+    // Combines all buckets overlapping [from, to], using the finest level that still holds
+    // each part of the range. The result covers whole buckets, so it may include values
+    // slightly outside the range.
+    Bucket query(double from, double to) const;
+
+    double bucketDuration(int level) const { return _durations[level]; }
+    // how far back the given level reaches
+    double retention(int level) const { return _durations[level] * BUCKETS; }
+
+private:
+    struct Slot
+    {
+        long long index;
+        Bucket bucket;
+    };
+
+    double _durations[LEVELS];
+    // level 0 buckets per bucket of each level, BUCKETS^level
+    long long _spans[LEVELS];
+    Slot _slots[LEVELS][BUCKETS];
+    long long _latest[LEVELS];
+
+    static Bucket emptyBucket()
+    {
+        Bucket bucket;
+        bucket.sum = T(0);
+        bucket.min = std::numeric_limits<T>::max();
+        bucket.max = std::numeric_limits<T>::lowest();
+        bucket.count = 0;
+        return bucket;
+    }
+
+    static void merge(Bucket & into, const Bucket & from)
+    {
+        if(from.count == 0)
+            return;
+
+        into.sum += from.sum;
+        into.min = std::min(into.min, from.min);
+        into.max = std::max(into.max, from.max);
+        into.count += from.count;
+    }
+
+    static long long floorDivide(long long value, long long divisor)
+    {
+        return value >= 0 ? value / divisor : -((-value + divisor - 1) / divisor);
+    }
+
+    // Only the level 0 index is computed from the time; coarser levels divide it by _spans in
+    // integers, so every level agrees on which bucket a time falls into
+    long long bucketIndex(double time) const
+    {
+        const double position = time / _durations[0];
+        const long long index = (long long)position;
+        return (double)index > position ? index - 1 : index;
+    }
+
+    static int slotOf(long long index)
+    {
+        const long long slot = index % BUCKETS;
+        return int(slot < 0 ? slot + BUCKETS : slot);
+    }
+
+    // bucket index at level, or nullptr if it has been overwritten or never filled
+    const Bucket * find(int level, long long index) const
+    {
+        const Slot & slot = _slots[level][slotOf(index)];
+        return slot.index == index ? &slot.bucket : nullptr;
+    }
+};
+
+template<int BUCKETS, int LEVELS, typename T>
+RollupTimeSeries<BUCKETS, LEVELS, T>::RollupTimeSeries(double resolution)
+{
+    static_assert(BUCKETS > 1 && LEVELS > 0, "RollupTimeSeries needs at least two buckets and one level");
+
+    double duration = resolution;
+    long long span = 1;
+    for(int level = 0 ; level < LEVELS ; level++)
+    {
+        _durations[level] = duration;
+        _spans[level] = span;
+        _latest[level] = std::numeric_limits<long long>::min();
+        duration *= BUCKETS;
+        span *= BUCKETS;
+
+        for(int i = 0 ; i < BUCKETS ; i++)
+        {
+            _slots[level][i].index = std::numeric_limits<long long>::min();
+            _slots[level][i].bucket = emptyBucket();
+        }
+    }
+}
+
+template<int BUCKETS, int LEVELS, typename T>
+void RollupTimeSeries<BUCKETS, LEVELS, T>::addValue(double time, T value)
+{
+    const long long index0 = bucketIndex(time);
+    for(int level = 0 ; level < LEVELS ; level++)
+    {
+        const long long index = floorDivide(index0, _spans[level]);
+        _latest[level] = std::max(_latest[level], index);
+
+        Slot & slot = _slots[level][slotOf(index)];
+        if(slot.index != index)
+        {
+            // a value older than the ring can hold has nowhere to go at this level
+            if(slot.index > index)
+                continue;
+
+            slot.index = index;
+            slot.bucket = emptyBucket();
+        }
+
+        Bucket & bucket = slot.bucket;
+        bucket.sum += value;
+        bucket.min = std::min(bucket.min, value);
+        bucket.max = std::max(bucket.max, value);
+        bucket.count++;
+    }
+}
+
+template<int BUCKETS, int LEVELS, typename T>
+typename RollupTimeSeries<BUCKETS, LEVELS, T>::Bucket RollupTimeSeries<BUCKETS, LEVELS, T>::query(double from, double to) const
+{
+    Bucket result = emptyBucket();
+    if(to < from || _latest[0] == std::numeric_limits<long long>::min())
+        return result;
+
+    // Each level covers the part of the range the finer levels no longer hold.
+    // childBoundary is the oldest bucket index still held by the previous level.
+    const long long from0 = bucketIndex(from);
+    const long long to0 = bucketIndex(to);
+    long long childBoundary = 0;
+    for(int level = 0 ; level < LEVELS ; level++)
+    {
+        const long long latest = _latest[level];
+        const long long oldest = latest - (BUCKETS - 1);
+        const long long first = floorDivide(from0, _spans[level]);
+        const long long last = floorDivide(to0, _spans[level]);
+
+        long long upper = latest;
+        if(level > 0)
+        {
+            const long long parent = floorDivide(childBoundary, BUCKETS);
+            const Bucket * straddling = find(level, parent);
+            if(parent * BUCKETS < childBoundary && parent <= last && straddling != nullptr)
+            {
+                // only the part of this bucket before childBoundary is missing; take its sum
+                // and count without the children already covered, and its min/max as they are
+                Bucket remainder = *straddling;
+                for(long long child = childBoundary ; child < (parent + 1) * BUCKETS ; child++)
+                {
+                    const Bucket * covered = find(level - 1, child);
+                    if(covered == nullptr)
+                        continue;
+
+                    remainder.sum -= covered->sum;
+                    remainder.count -= covered->count;
+                }
+
+                if(remainder.count > 0)
+                    merge(result, remainder);
+            }
+            upper = parent - 1;
+        }
+
+        const long long lower = std::max(first, oldest);
+        for(long long index = std::min(last, upper) ; index >= lower ; index--)
+        {
+            const Bucket * bucket = find(level, index);
+            if(bucket != nullptr)
+                merge(result, *bucket);
+        }
+
+        if(first >= oldest)
+            break;
+
+        childBoundary = oldest;
+    }
+
+    return result;
+}
+
+#endif
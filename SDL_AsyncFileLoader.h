@@ -0,0 +1,203 @@
+#ifndef _SDL_ASYNC_FILE_LOADER_H_
+#define _SDL_ASYNC_FILE_LOADER_H_
+
+/*
+ LICENSE - this file is public domain
+
+ This is free and unencumbered software released into the public domain.
+
+ Anyone is free to copy, modify, publish, use, compile, sell, or
+ distribute this software, either in source code form or as a compiled
+ binary, for any purpose, commercial or non-commercial, and by any
+ means.
+
+ In jurisdictions that recognize copyright laws, the author or authors
+ of this software dedicate any and all copyright interest in the
+ software to the public domain. We make this dedication for the benefit
+ of the public at large and to the detriment of our heirs and
+ successors. We intend this dedication to be an overt act of
+ relinquishment in perpetuity of all present and future rights to this
+ software under copyright law.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+ For more information, please refer to <http://unlicense.org/>
+
+ */
+
+#include "SDL_FileStream.h"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <future>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+// Loads files on a pool of worker threads. At most maxInFlight requests are queued or
+// being read at any time; submitting more blocks the caller until a slot frees up, so
+// a batch of thousands of paths never turns into thousands of open files.
+// Callbacks run on the worker threads and must not submit new requests themselves, nor
+// throw: an exception leaving a callback ends the program. Errors while reading (such as
+// std::bad_alloc) reach futures through the future, and callbacks as success = false.
+class SDL_AsyncFileLoader
+{
+public:
+    typedef std::function<void(const std::string & path, std::vector<unsigned char> & data, bool success)> Callback;
+
+    SDL_AsyncFileLoader(unsigned int threadCount = 0, unsigned int maxInFlight = 64)
+    :_maxInFlight(maxInFlight > 0 ? maxInFlight : 1)
+    ,_inFlight(0)
+    ,_stop(false)
+    {
+        if(threadCount == 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+        _workers.reserve(threadCount);
+        for(unsigned int i=0 ; i < threadCount ; i++)
+            _workers.push_back(std::thread(&SDL_AsyncFileLoader::workerLoop, this));
+    }
+
+    // finishes every request that has already been submitted
+    ~SDL_AsyncFileLoader()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _workAvailable.notify_all();
+        for(unsigned int i=0 ; i < _workers.size() ; i++)
+            _workers[i].join();
+    }
+
+    SDL_AsyncFileLoader(const SDL_AsyncFileLoader &) = delete;
+    SDL_AsyncFileLoader & operator = (const SDL_AsyncFileLoader &) = delete;
+
+    // The future holds the same data SDL_FileStream::readFile<T>() would have returned, or
+    // the exception thrown while reading it.
+    template<typename T>
+    std::future<std::vector<T>> load(const std::string & path)
+    {
+        std::shared_ptr<std::promise<std::vector<T>>> promise = std::make_shared<std::promise<std::vector<T>>>();
+        std::future<std::vector<T>> result = promise->get_future();
+        submit([path, promise]()
+        {
+            try
+            {
+                promise->set_value(SDL_FileStream::readFile<T>(path, static_cast<unsigned int>(SDL_FileStream::OpenFlags::READ_ONLY) | static_cast<unsigned int>(SDL_FileStream::OpenFlags::BINARY)));
+            }
+            catch(...)
+            {
+                promise->set_exception(std::current_exception());
+            }
+        });
+        return result;
+    }
+
+    template<typename T>
+    std::vector<std::future<std::vector<T>>> load(const std::vector<std::string> & paths)
+    {
+        std::vector<std::future<std::vector<T>>> results;
+        results.reserve(paths.size());
+        for(unsigned int i=0 ; i < paths.size() ; i++)
+            results.push_back(load<T>(paths[i]));
+        return results;
+    }
+
+    // calls callback once per path, on a worker thread, as each file completes
+    void load(const std::vector<std::string> & paths, const Callback & callback)
+    {
+        for(unsigned int i=0 ; i < paths.size() ; i++)
+        {
+            const std::string path = paths[i];
+            submit([path, callback]()
+            {
+                std::vector<unsigned char> data;
+                bool success = false;
+                try
+                {
+                    SDL_FileStream stream(path, static_cast<unsigned int>(SDL_FileStream::OpenFlags::READ_ONLY) | static_cast<unsigned int>(SDL_FileStream::OpenFlags::BINARY));
+                    success = stream.isOpen();
+                    if(success)
+                        stream.read(data);
+                }
+                catch(...)
+                {
+                    success = false;
+                    std::vector<unsigned char>().swap(data);
+                }
+                callback(path, data, success);
+            });
+        }
+    }
+
+    // blocks until every submitted request has completed
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _slotAvailable.wait(lock, [this]() { return _inFlight == 0; });
+    }
+
+    unsigned int inFlight() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _inFlight;
+    }
+
+    unsigned int threadCount() const { return (unsigned int)_workers.size(); }
+
+private:
+    const unsigned int _maxInFlight;
+    unsigned int _inFlight;
+    bool _stop;
+
+    std::vector<std::thread> _workers;
+    std::deque<std::function<void()>> _queue;
+    mutable std::mutex _mutex;
+    std::condition_variable _workAvailable;
+    std::condition_variable _slotAvailable;
+
+    void submit(const std::function<void()> & job)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _slotAvailable.wait(lock, [this]() { return _inFlight < _maxInFlight; });
+            _inFlight++;
+            _queue.push_back(job);
+        }
+        _workAvailable.notify_one();
+    }
+
+    void workerLoop()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        for(;;)
+        {
+            _workAvailable.wait(lock, [this]() { return _stop || !_queue.empty(); });
+            if(_queue.empty())
+                return;
+
+            std::function<void()> job = std::move(_queue.front());
+            _queue.pop_front();
+            lock.unlock();
+
+            job();
+
+            lock.lock();
+            _inFlight--;
+            _slotAvailable.notify_all();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,635 @@
+#ifndef _SDL_COMPRESSED_FILE_STREAM_H_
+#define _SDL_COMPRESSED_FILE_STREAM_H_
+
+/*
+ LICENSE - this file is public domain
+
+ This is free and unencumbered software released into the public domain.
+
+ Anyone is free to copy, modify, publish, use, compile, sell, or
+ distribute this software, either in source code form or as a compiled
+ binary, for any purpose, commercial or non-commercial, and by any
+ means.
+
+ In jurisdictions that recognize copyright laws, the author or authors
+ of this software dedicate any and all copyright interest in the
+ software to the public domain. We make this dedication for the benefit
+ of the public at large and to the detriment of our heirs and
+ successors. We intend this dedication to be an overt act of
+ relinquishment in perpetuity of all present and future rights to this
+ software under copyright law.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+ For more information, please refer to <http://unlicense.org/>
+
+ */
+
+/*
+ Compressed file layout (native byte order of the host that wrote it):
+
+   blocks   : independently compressed blocks of blockSize uncompressed bytes (the last one may be shorter).
+              A block whose compressed size equals its raw size is stored uncompressed.
+   index    : block count x { file offset, compressed size, raw size }
+   footer   : index offset, block count, total raw size, block size, magic "SLZ1"
+
+ Blocks are compressed with LZBlockCodec, a small LZ77 codec in the spirit of LZ4:
+ every sequence is a token (4 bits literal length, 4 bits match length - 4), optional
+ length extension bytes, the literals, and a 16-bit match offset. The final sequence
+ of a block carries literals only.
+ */
+
+#include "SDL_FileStream.h"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+class LZBlockCodec
+{
+public:
+    static size_t compressBound(size_t size)
+    {
+        return size + size / 255 + 16;
+    }
+
+    // Returns the compressed size, or 0 if the result would not fit in dstCapacity.
+    static size_t compress(const unsigned char * src, size_t srcSize, unsigned char * dst, size_t dstCapacity)
+    {
+        const size_t HashBits = 14;
+        const size_t MinMatch = 4;
+        const size_t MaxOffset = 65535;
+        // the tail of a block is always emitted as literals
+        const size_t TailLiterals = 12;
+
+        std::vector<uint32_t> table(size_t(1) << HashBits, 0);
+
+        unsigned char * op = dst;
+        unsigned char * const oend = dst + dstCapacity;
+        size_t anchor = 0;
+        size_t ip = 1;
+
+        if(srcSize > TailLiterals)
+        {
+            const size_t limit = srcSize - TailLiterals;
+            table[hash(read32(src), HashBits)] = 0;
+            while(ip < limit)
+            {
+                const uint32_t sequence = read32(src + ip);
+                const uint32_t h = hash(sequence, HashBits);
+                size_t ref = table[h];
+                table[h] = static_cast<uint32_t>(ip);
+
+                if(ref >= ip || ip - ref > MaxOffset || read32(src + ref) != sequence)
+                {
+                    // skip faster through data that does not compress
+                    ip += 1 + ((ip - anchor) >> 6);
+                    continue;
+                }
+
+                while(ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1])
+                {
+                    ip--;
+                    ref--;
+                }
+
+                size_t length = MinMatch;
+                while(ip + length < limit && src[ref + length] == src[ip + length])
+                    length++;
+
+                op = emitSequence(op, oend, src + anchor, ip - anchor, ip - ref, length - MinMatch);
+                if(op == nullptr)
+                    return 0;
+
+                ip += length;
+                anchor = ip;
+                if(ip - 2 < limit)
+                    table[hash(read32(src + ip - 2), HashBits)] = static_cast<uint32_t>(ip - 2);
+            }
+        }
+
+        op = emitLiterals(op, oend, src + anchor, srcSize - anchor);
+        return op == nullptr ? 0 : static_cast<size_t>(op - dst);
+    }
+
+    // Returns false if src is malformed or does not expand to exactly dstSize bytes.
+    static bool decompress(const unsigned char * src, size_t srcSize, unsigned char * dst, size_t dstSize)
+    {
+        const unsigned char * ip = src;
+        const unsigned char * const iend = src + srcSize;
+        unsigned char * op = dst;
+        unsigned char * const oend = dst + dstSize;
+
+        while(ip < iend)
+        {
+            const unsigned int token = *ip++;
+
+            size_t literals = token >> 4;
+            if(literals == 15 && !readLength(ip, iend, literals))
+                return false;
+            if(literals > size_t(iend - ip) || literals > size_t(oend - op))
+                return false;
+
+            memcpy(op, ip, literals);
+            ip += literals;
+            op += literals;
+
+            if(ip == iend)
+                break;
+
+            if(iend - ip < 2)
+                return false;
+            const size_t offset = size_t(ip[0]) | (size_t(ip[1]) << 8);
+            ip += 2;
+            if(offset == 0 || offset > size_t(op - dst))
+                return false;
+
+            size_t length = token & 15;
+            if(length == 15 && !readLength(ip, iend, length))
+                return false;
+            length += 4;
+            if(length > size_t(oend - op))
+                return false;
+
+            const unsigned char * match = op - offset;
+            if(offset >= length)
+            {
+                memcpy(op, match, length);
+                op += length;
+            }
+            else
+            {
+                for(size_t i=0 ; i < length ; i++)
+                    *op++ = *match++;
+            }
+        }
+
+        return op == oend;
+    }
+
+private:
+    static uint32_t read32(const unsigned char * p)
+    {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    static uint32_t hash(uint32_t sequence, size_t bits)
+    {
+        return (sequence * 2654435761u) >> (32 - bits);
+    }
+
+    static bool readLength(const unsigned char * & ip, const unsigned char * iend, size_t & length)
+    {
+        unsigned int byte;
+        do
+        {
+            if(ip >= iend)
+                return false;
+            byte = *ip++;
+            length += byte;
+        } while(byte == 255);
+        return true;
+    }
+
+    static unsigned char * writeLength(unsigned char * op, size_t length)
+    {
+        while(length >= 255)
+        {
+            *op++ = 255;
+            length -= 255;
+        }
+        *op++ = static_cast<unsigned char>(length);
+        return op;
+    }
+
+    static unsigned char * emitSequence(unsigned char * op, unsigned char * oend, const unsigned char * literals, size_t literalCount, size_t offset, size_t matchLength)
+    {
+        const size_t worstCase = 1 + literalCount / 255 + 1 + literalCount + 2 + matchLength / 255 + 1;
+        if(worstCase > size_t(oend - op))
+            return nullptr;
+
+        unsigned char * token = op++;
+        *token = static_cast<unsigned char>((literalCount >= 15 ? 15 : literalCount) << 4);
+        if(literalCount >= 15)
+            op = writeLength(op, literalCount - 15);
+
+        memcpy(op, literals, literalCount);
+        op += literalCount;
+
+        *op++ = static_cast<unsigned char>(offset & 0xFF);
+        *op++ = static_cast<unsigned char>(offset >> 8);
+
+        *token |= static_cast<unsigned char>(matchLength >= 15 ? 15 : matchLength);
+        if(matchLength >= 15)
+            op = writeLength(op, matchLength - 15);
+
+        return op;
+    }
+
+    static unsigned char * emitLiterals(unsigned char * op, unsigned char * oend, const unsigned char * literals, size_t literalCount)
+    {
+        const size_t worstCase = 1 + literalCount / 255 + 1 + literalCount;
+        if(worstCase > size_t(oend - op))
+            return nullptr;
+
+        *op++ = static_cast<unsigned char>((literalCount >= 15 ? 15 : literalCount) << 4);
+        if(literalCount >= 15)
+            op = writeLength(op, literalCount - 15);
+
+        memcpy(op, literals, literalCount);
+        return op + literalCount;
+    }
+};
+
+// Same read/write interface as SDL_FileStream, but the data on disk is block compressed.
+// A stream opened with OpenFlags::READ_ONLY reads and seeks; any other flags create a new
+// file for writing. Large reads decompress whole blocks in parallel straight into the
+// destination buffer.
+class SDL_CompressedFileStream
+{
+public:
+    static const size_t DefaultBlockSize = 256 * 1024;
+
+    SDL_CompressedFileStream(const std::string & fullpath, unsigned int flags, size_t blockSize = DefaultBlockSize)
+    :_stream(fullpath, flags | static_cast<unsigned int>(SDL_FileStream::OpenFlags::BINARY))
+    ,_writing((flags & static_cast<unsigned int>(SDL_FileStream::OpenFlags::READ_ONLY)) == 0)
+    ,_blockSize(blockSize > 0 ? blockSize : DefaultBlockSize)
+    ,_position(0)
+    ,_size(0)
+    ,_cachedBlock(-1)
+    ,_threadCount(std::max(1u, std::thread::hardware_concurrency()))
+    {
+        if(_stream.isOpen() && !_writing && !readIndex())
+            _stream.close();
+    }
+
+    ~SDL_CompressedFileStream()
+    {
+        close();
+    }
+
+    SDL_CompressedFileStream(const SDL_CompressedFileStream &) = delete;
+    SDL_CompressedFileStream & operator = (const SDL_CompressedFileStream &) = delete;
+
+    bool isOpen() const
+    {
+        return _stream.isOpen();
+    }
+
+    // writes the last block, the index and the footer when writing. Returns false if any of
+    // them could not be written, in which case the file is incomplete
+    bool close()
+    {
+        bool success = true;
+        if(isOpen() && _writing)
+        {
+            success = flushBlock();
+            success = success && writeIndex();
+        }
+        _stream.close();
+        _blocks.clear();
+        _cache.clear();
+        return success;
+    }
+
+    // number of threads used to decompress large reads
+    void setThreadCount(unsigned int threadCount) { _threadCount = threadCount > 0 ? threadCount : 1; }
+
+    uint64_t size() const { return _size; }
+    int64_t tell() const { return isOpen() ? static_cast<int64_t>(_position) : -1; }
+
+    uint64_t bytesLeft() const
+    {
+        if(!isOpen() || _writing)
+            return 0;
+
+        return _size - _position;
+    }
+
+    // seeks within the uncompressed data. Only supported when reading.
+    int64_t seek(int64_t offset, int whence = RW_SEEK_SET)
+    {
+        if(!isOpen() || _writing)
+            return -1;
+
+        int64_t base = 0;
+        if(whence == RW_SEEK_CUR)
+            base = static_cast<int64_t>(_position);
+        else if(whence == RW_SEEK_END)
+            base = static_cast<int64_t>(_size);
+
+        const int64_t target = base + offset;
+        if(target < 0 || target > static_cast<int64_t>(_size))
+            return -1;
+
+        _position = static_cast<uint64_t>(target);
+        return target;
+    }
+
+    // returns the number of uncompressed bytes actually read
+    size_t read(size_t bytes, void * data)
+    {
+        if(!isOpen() || _writing)
+            return 0;
+
+        bytes = static_cast<size_t>(std::min<uint64_t>(bytes, _size - _position));
+        unsigned char * out = static_cast<unsigned char*>(data);
+        size_t done = 0;
+        while(done < bytes)
+        {
+            const size_t block = static_cast<size_t>(_position / _blockSize);
+            const size_t inBlock = static_cast<size_t>(_position % _blockSize);
+
+            // whole blocks go straight to the destination
+            size_t wholeBlocks = 0;
+            if(inBlock == 0)
+            {
+                while(block + wholeBlocks < _blocks.size() && done + rawEnd(block + wholeBlocks) - _position <= bytes)
+                    wholeBlocks++;
+            }
+
+            if(wholeBlocks > 0)
+            {
+                if(!decompressBlocks(block, wholeBlocks, out + done))
+                    break;
+
+                const size_t decoded = static_cast<size_t>(rawEnd(block + wholeBlocks - 1) - _position);
+                done += decoded;
+                _position += decoded;
+                continue;
+            }
+
+            if(!cacheBlock(block))
+                break;
+
+            const size_t available = _cache.size() - inBlock;
+            const size_t count = std::min(available, bytes - done);
+            memcpy(out + done, &_cache[inBlock], count);
+            done += count;
+            _position += count;
+        }
+        return done;
+    }
+
+    template<typename T>
+    size_t read(size_t itemCount, std::vector<T> & val)
+    {
+        if(itemCount == 0)
+            return 0;
+
+        const size_t indexToReadFrom = val.size();
+        val.resize(val.size() + itemCount);
+        const size_t bytesRead = read(sizeof(T) * itemCount, &val[indexToReadFrom]);
+        val.resize(indexToReadFrom + bytesRead / sizeof(T));
+        return bytesRead;
+    }
+
+    template<typename T>
+    size_t read(std::vector<T> & val)
+    {
+        return read(static_cast<size_t>(bytesLeft()) / sizeof(T), val);
+    }
+
+    size_t read(std::string & val)
+    {
+        const size_t numBytesToRead = static_cast<size_t>(bytesLeft());
+        const size_t indexToReadFrom = val.size();
+        val.resize(val.size() + numBytesToRead);
+        const size_t bytesRead = read(numBytesToRead, &val[indexToReadFrom]);
+        val.resize(indexToReadFrom + bytesRead);
+        return bytesRead;
+    }
+
+    // returns the number of uncompressed bytes accepted
+    size_t write(size_t dataSize, const void * data)
+    {
+        if(!isOpen() || !_writing)
+            return 0;
+
+        const unsigned char * bytes = static_cast<const unsigned char*>(data);
+        size_t done = 0;
+        while(done < dataSize)
+        {
+            const size_t count = std::min(_blockSize - _cache.size(), dataSize - done);
+            _cache.insert(_cache.end(), bytes + done, bytes + done + count);
+            done += count;
+            if(_cache.size() == _blockSize && !flushBlock())
+                break;
+        }
+        _position += done;
+        _size = _position;
+        return done;
+    }
+
+    template<typename T>
+    size_t write(size_t numItems, const T * data)
+    {
+        return write(numItems * sizeof(T), static_cast<const void*>(data));
+    }
+
+    size_t write(const std::string & val)
+    {
+        return write(val.length(), static_cast<const void*>(val.data()));
+    }
+
+private:
+    struct BlockInfo
+    {
+        uint64_t offset;
+        uint32_t compressedSize;
+        uint32_t rawSize;
+    };
+
+    struct Footer
+    {
+        uint64_t indexOffset;
+        uint64_t blockCount;
+        uint64_t rawSize;
+        uint32_t blockSize;
+        char magic[4];
+    };
+
+    SDL_FileStream _stream;
+    const bool _writing;
+    size_t _blockSize;
+    uint64_t _position;
+    uint64_t _size;
+
+    std::vector<BlockInfo> _blocks;
+    // uncompressed data of the block being written, or of block _cachedBlock when reading
+    std::vector<unsigned char> _cache;
+    std::vector<unsigned char> _compressed;
+    int64_t _cachedBlock;
+    unsigned int _threadCount;
+
+    uint64_t rawEnd(size_t block) const
+    {
+        return uint64_t(block) * _blockSize + _blocks[block].rawSize;
+    }
+
+    bool flushBlock()
+    {
+        if(_cache.empty())
+            return true;
+
+        _compressed.resize(LZBlockCodec::compressBound(_cache.size()));
+        size_t compressedSize = LZBlockCodec::compress(_cache.data(), _cache.size(), _compressed.data(), _compressed.size());
+        const void * payload = _compressed.data();
+        if(compressedSize == 0 || compressedSize >= _cache.size())
+        {
+            compressedSize = _cache.size();
+            payload = _cache.data();
+        }
+
+        BlockInfo info;
+        info.offset = _blocks.empty() ? 0 : _blocks.back().offset + _blocks.back().compressedSize;
+        info.compressedSize = static_cast<uint32_t>(compressedSize);
+        info.rawSize = static_cast<uint32_t>(_cache.size());
+
+        // the block stays cached until it is in the file, so the bytes write() accepted
+        // are not lost; a retry overwrites whatever part of it did get written
+        if(_stream.write(compressedSize, payload) != compressedSize)
+        {
+            _stream.seek(static_cast<int64_t>(info.offset));
+            return false;
+        }
+
+        _blocks.push_back(info);
+        _cache.clear();
+        return true;
+    }
+
+    bool writeIndex()
+    {
+        Footer footer;
+        footer.indexOffset = _blocks.empty() ? 0 : _blocks.back().offset + _blocks.back().compressedSize;
+        footer.blockCount = _blocks.size();
+        footer.rawSize = _size;
+        footer.blockSize = static_cast<uint32_t>(_blockSize);
+        memcpy(footer.magic, "SLZ1", 4);
+
+        const size_t indexSize = _blocks.size() * sizeof(BlockInfo);
+        bool success = _stream.write(indexSize, static_cast<const void*>(_blocks.data())) == indexSize;
+        success &= _stream.write(sizeof(footer), static_cast<const void*>(&footer)) == sizeof(footer);
+        return success;
+    }
+
+    bool readIndex()
+    {
+        const uint64_t fileSize = _stream.size();
+        Footer footer;
+        if(fileSize < sizeof(footer) || _stream.seek(static_cast<int64_t>(fileSize - sizeof(footer))) < 0)
+            return false;
+        if(_stream.read(sizeof(footer), &footer) != sizeof(footer) || memcmp(footer.magic, "SLZ1", 4) != 0 || footer.blockSize == 0)
+            return false;
+
+        // blockCount is checked against the space before multiplying so a corrupt count can't wrap
+        if(footer.indexOffset > fileSize - sizeof(footer))
+            return false;
+        const uint64_t indexSpace = fileSize - sizeof(footer) - footer.indexOffset;
+        if(footer.blockCount > indexSpace / sizeof(BlockInfo))
+            return false;
+        const uint64_t indexSize = footer.blockCount * sizeof(BlockInfo);
+        if(indexSize != indexSpace)
+            return false;
+
+        _blocks.resize(static_cast<size_t>(footer.blockCount));
+        if(_stream.seek(static_cast<int64_t>(footer.indexOffset)) < 0 || _stream.read(static_cast<size_t>(indexSize), _blocks.data()) != indexSize)
+            return false;
+
+        _blockSize = footer.blockSize;
+        _size = footer.rawSize;
+
+        // decompressBlocks() relies on the blocks being back to back from the start of the file
+        uint64_t total = 0;
+        uint64_t expectedOffset = 0;
+        for(size_t i=0 ; i < _blocks.size() ; i++)
+        {
+            const BlockInfo & block = _blocks[i];
+            if(block.offset != expectedOffset || block.compressedSize > footer.indexOffset - block.offset)
+                return false;
+            if(block.rawSize > _blockSize || block.compressedSize > block.rawSize)
+                return false;
+            expectedOffset = block.offset + block.compressedSize;
+            if(i + 1 < _blocks.size() && block.rawSize != _blockSize)
+                return false;
+            total += block.rawSize;
+        }
+        return total == _size;
+    }
+
+    bool decodeBlock(const BlockInfo & block, const unsigned char * compressed, unsigned char * out) const
+    {
+        if(block.compressedSize == block.rawSize)
+        {
+            memcpy(out, compressed, block.rawSize);
+            return true;
+        }
+        return LZBlockCodec::decompress(compressed, block.compressedSize, out, block.rawSize);
+    }
+
+    bool cacheBlock(size_t block)
+    {
+        if(_cachedBlock == static_cast<int64_t>(block))
+            return true;
+
+        _cachedBlock = -1;
+        const BlockInfo & info = _blocks[block];
+        _compressed.resize(info.compressedSize);
+        _cache.resize(info.rawSize);
+        if(_stream.seek(static_cast<int64_t>(info.offset)) < 0 || _stream.read(info.compressedSize, _compressed.data()) != info.compressedSize)
+            return false;
+        if(!decodeBlock(info, _compressed.data(), _cache.data()))
+            return false;
+
+        _cachedBlock = static_cast<int64_t>(block);
+        return true;
+    }
+
+    // blocks are consecutive on disk, so their compressed data is fetched in one read
+    bool decompressBlocks(size_t first, size_t count, unsigned char * out)
+    {
+        const BlockInfo & last = _blocks[first + count - 1];
+        const uint64_t start = _blocks[first].offset;
+        const size_t compressedBytes = static_cast<size_t>(last.offset + last.compressedSize - start);
+        std::vector<unsigned char> compressed(compressedBytes);
+        if(_stream.seek(static_cast<int64_t>(start)) < 0 || _stream.read(compressedBytes, compressed.data()) != compressedBytes)
+            return false;
+
+        std::atomic<size_t> nextBlock(0);
+        std::atomic<bool> success(true);
+        auto work = [&]()
+        {
+            for(size_t i = nextBlock++ ; i < count ; i = nextBlock++)
+            {
+                const BlockInfo & info = _blocks[first + i];
+                if(!decodeBlock(info, &compressed[static_cast<size_t>(info.offset - start)], out + i * _blockSize))
+                    success = false;
+            }
+        };
+
+        const unsigned int threadCount = static_cast<unsigned int>(std::min<size_t>(_threadCount, count));
+        std::vector<std::thread> threads;
+        for(unsigned int i=1 ; i < threadCount ; i++)
+            threads.push_back(std::thread(work));
+        work();
+        for(unsigned int i=0 ; i < threads.size() ; i++)
+            threads[i].join();
+
+        return success;
+    }
+};
+
+#endif
@@ -31,14 +31,452 @@
  
  */
 
+/*
+ By default all I/O goes through SDL_RWops. Define SDL_FILESTREAM_POSIX before including
+ this file to make SDL_FileStream use open/pread/pwrite directly instead; SDL is then not
+ needed at all. Both backends are available as BasicFileStream<Backend> when SDL is present.
+ */
+#if !defined(SDL_FILESTREAM_POSIX)
 #include <SDL2/SDL.h>
+#endif
+
+#if defined(SDL_FILESTREAM_POSIX) || defined(__unix__) || defined(__APPLE__)
+#define SDL_FILESTREAM_HAS_POSIX 1
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <cerrno>
+#include <cstdlib>
+#endif
 
 #include <string>
 #include <vector>
 #include <cstdio>
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
 //#include <filesystem>
 
-class SDL_FileStream
+#if !defined(RW_SEEK_SET)
+#define RW_SEEK_SET 0
+#define RW_SEEK_CUR 1
+#define RW_SEEK_END 2
+#endif
+
+enum class FileAccessHint
+{
+    NORMAL,
+    SEQUENTIAL,
+    RANDOM,
+    WILL_NEED,
+    DONT_NEED,
+};
+
+// I/O counters and latency histograms. Streams record into their own instance (when
+// enabled) and into global(), which aggregates every instrumented stream in the process.
+// All counters are relaxed atomics, so recording is safe from any thread.
+class FileStreamStats
+{
+public:
+    enum Operation
+    {
+        READ = 0,
+        WRITE = 1,
+        OPERATION_COUNT = 2,
+    };
+    
+    // bucket i counts calls that took [2^i, 2^(i+1)) nanoseconds, the last one everything slower
+    static const unsigned int HistogramBuckets = 36;
+    
+    FileStreamStats()
+    {
+        reset();
+    }
+    
+    void reset()
+    {
+        for(unsigned int op=0 ; op < OPERATION_COUNT ; op++)
+        {
+            _calls[op].store(0, std::memory_order_relaxed);
+            _bytes[op].store(0, std::memory_order_relaxed);
+            _nanoseconds[op].store(0, std::memory_order_relaxed);
+            _maxNanoseconds[op].store(0, std::memory_order_relaxed);
+            for(unsigned int bucket=0 ; bucket < HistogramBuckets ; bucket++)
+                _histogram[op][bucket].store(0, std::memory_order_relaxed);
+        }
+    }
+    
+    void record(Operation op, size_t bytes, std::chrono::steady_clock::time_point start)
+    {
+        const int64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        const uint64_t nanoseconds = elapsed > 0 ? static_cast<uint64_t>(elapsed) : 0;
+        add(op, bytes, nanoseconds);
+        
+        FileStreamStats & processStats = global();
+        if(this != &processStats)
+            processStats.add(op, bytes, nanoseconds);
+    }
+    
+    uint64_t calls(Operation op) const { return _calls[op].load(std::memory_order_relaxed); }
+    uint64_t bytes(Operation op) const { return _bytes[op].load(std::memory_order_relaxed); }
+    uint64_t totalNanoseconds(Operation op) const { return _nanoseconds[op].load(std::memory_order_relaxed); }
+    uint64_t maxNanoseconds(Operation op) const { return _maxNanoseconds[op].load(std::memory_order_relaxed); }
+    uint64_t histogram(Operation op, unsigned int bucket) const { return _histogram[op][bucket].load(std::memory_order_relaxed); }
+    
+    // upper bound, in nanoseconds, of the bucket holding the given fraction (0-1) of calls
+    uint64_t percentileNanoseconds(Operation op, double fraction) const
+    {
+        const uint64_t total = calls(op);
+        if(total == 0)
+            return 0;
+        
+        const uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(fraction * double(total) + 0.5));
+        uint64_t seen = 0;
+        for(unsigned int bucket=0 ; bucket < HistogramBuckets ; bucket++)
+        {
+            seen += histogram(op, bucket);
+            if(seen >= target)
+                return std::min(uint64_t(1) << (bucket + 1), maxNanoseconds(op));
+        }
+        return maxNanoseconds(op);
+    }
+    
+    std::string report(const std::string & title = "file I/O") const
+    {
+        static const char * names[OPERATION_COUNT] = { "read", "write" };
+        char line[256];
+        std::string text = title + "\n";
+        for(unsigned int i=0 ; i < OPERATION_COUNT ; i++)
+        {
+            const Operation op = static_cast<Operation>(i);
+            const uint64_t count = calls(op);
+            if(count == 0)
+                continue;
+            
+            const double seconds = double(totalNanoseconds(op)) * 1e-9;
+            const double megabytes = double(bytes(op)) / (1024.0 * 1024.0);
+            snprintf(line, sizeof(line), "  %-5s %12llu calls %12.2f MB %10.1f MB/s  mean %9.0f ns  p50 <%llu ns  p99 <%llu ns  max %llu ns\n",
+                     names[i], (unsigned long long)count, megabytes, seconds > 0 ? megabytes / seconds : 0.0,
+                     double(totalNanoseconds(op)) / double(count),
+                     (unsigned long long)percentileNanoseconds(op, 0.5), (unsigned long long)percentileNanoseconds(op, 0.99),
+                     (unsigned long long)maxNanoseconds(op));
+            text += line;
+            
+            for(unsigned int bucket=0 ; bucket < HistogramBuckets ; bucket++)
+            {
+                const uint64_t hits = histogram(op, bucket);
+                if(hits == 0)
+                    continue;
+                
+                snprintf(line, sizeof(line), "    < %12llu ns %12llu\n", (unsigned long long)(uint64_t(1) << (bucket + 1)), (unsigned long long)hits);
+                text += line;
+            }
+        }
+        return text;
+    }
+    
+    static FileStreamStats & global()
+    {
+        static FileStreamStats stats;
+        return stats;
+    }
+    
+    // newly opened streams record statistics when this is set
+    static std::atomic<bool> & enabledByDefault()
+    {
+        static std::atomic<bool> enabled(false);
+        return enabled;
+    }
+    
+private:
+    std::atomic<uint64_t> _calls[OPERATION_COUNT];
+    std::atomic<uint64_t> _bytes[OPERATION_COUNT];
+    std::atomic<uint64_t> _nanoseconds[OPERATION_COUNT];
+    std::atomic<uint64_t> _maxNanoseconds[OPERATION_COUNT];
+    std::atomic<uint64_t> _histogram[OPERATION_COUNT][HistogramBuckets];
+    
+    void add(Operation op, size_t byteCount, uint64_t nanoseconds)
+    {
+        _calls[op].fetch_add(1, std::memory_order_relaxed);
+        _bytes[op].fetch_add(byteCount, std::memory_order_relaxed);
+        _nanoseconds[op].fetch_add(nanoseconds, std::memory_order_relaxed);
+        _histogram[op][bucketOf(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+        
+        uint64_t previous = _maxNanoseconds[op].load(std::memory_order_relaxed);
+        while(nanoseconds > previous && !_maxNanoseconds[op].compare_exchange_weak(previous, nanoseconds, std::memory_order_relaxed))
+        {
+        }
+    }
+    
+    static unsigned int bucketOf(uint64_t nanoseconds)
+    {
+        unsigned int bucket = 0;
+        while(nanoseconds > 1 && bucket < HistogramBuckets - 1)
+        {
+            nanoseconds >>= 1;
+            bucket++;
+        }
+        return bucket;
+    }
+};
+
+/*
+ A backend provides the raw file operations for BasicFileStream. mode is an fopen style
+ string ("r", "w+", "a+", optionally followed by "b"). readAt/writeAt do not move the
+ file position.
+ */
+#if !defined(SDL_FILESTREAM_POSIX)
+class SDL_RWopsFileBackend
+{
+public:
+    SDL_RWopsFileBackend()
+    :_ops(nullptr)
+    {
+    }
+    
+    bool open(const std::string & fullpath, const std::string & mode)
+    {
+        _ops = SDL_RWFromFile(fullpath.c_str(), mode.c_str());
+        return _ops != nullptr;
+    }
+    
+    void close()
+    {
+        if(_ops != nullptr)
+            SDL_RWclose(_ops);
+        
+        _ops = nullptr;
+    }
+    
+    bool isOpen() const { return _ops != nullptr; }
+    
+    size_t read(void * data, size_t bytes) { return SDL_RWread(_ops, data, 1, bytes); }
+    size_t write(const void * data, size_t bytes) { return SDL_RWwrite(_ops, data, 1, bytes); }
+    
+    // SDL_RWops has no positional I/O, so this seeks and restores under a lock
+    size_t readAt(uint64_t offset, void * data, size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(_positionalMutex);
+        const int64_t position = SDL_RWtell(_ops);
+        if(SDL_RWseek(_ops, static_cast<int64_t>(offset), RW_SEEK_SET) < 0)
+            return 0;
+        
+        const size_t bytesRead = SDL_RWread(_ops, data, 1, bytes);
+        SDL_RWseek(_ops, position, RW_SEEK_SET);
+        return bytesRead;
+    }
+    
+    size_t writeAt(uint64_t offset, const void * data, size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(_positionalMutex);
+        const int64_t position = SDL_RWtell(_ops);
+        if(SDL_RWseek(_ops, static_cast<int64_t>(offset), RW_SEEK_SET) < 0)
+            return 0;
+        
+        const size_t bytesWritten = SDL_RWwrite(_ops, data, 1, bytes);
+        SDL_RWseek(_ops, position, RW_SEEK_SET);
+        return bytesWritten;
+    }
+    
+    int64_t size() const { return SDL_RWsize(_ops); }
+    int64_t tell() const { return SDL_RWtell(_ops); }
+    int64_t seek(int64_t offset, int whence) { return SDL_RWseek(_ops, offset, whence); }
+    
+    void advise(FileAccessHint, uint64_t, uint64_t) {}
+    
+    static std::string prefPath(const std::string & organisation, const std::string & app)
+    {
+        char * path = SDL_GetPrefPath(organisation.c_str(), app.c_str());
+        std::string rVal(path);
+        SDL_free(path);
+        return rVal;
+    }
+    
+private:
+    SDL_RWops * _ops;
+    std::mutex _positionalMutex;
+};
+#endif
+
+#if defined(SDL_FILESTREAM_HAS_POSIX)
+class PosixFileBackend
+{
+public:
+    PosixFileBackend()
+    :_fd(-1)
+    {
+    }
+    
+    bool open(const std::string & fullpath, const std::string & mode)
+    {
+        int flags = O_RDONLY;
+        if(mode.find('w') != std::string::npos)
+            flags = O_RDWR | O_CREAT | O_TRUNC;
+        else if(mode.find('a') != std::string::npos)
+            flags = O_RDWR | O_CREAT | O_APPEND;
+        else if(mode.find('+') != std::string::npos)
+            flags = O_RDWR;
+        
+#if defined(O_CLOEXEC)
+        flags |= O_CLOEXEC;
+#endif
+        
+        do
+        {
+            _fd = ::open(fullpath.c_str(), flags, 0666);
+        } while(_fd < 0 && errno == EINTR);
+        
+        return _fd >= 0;
+    }
+    
+    void close()
+    {
+        if(_fd >= 0)
+            ::close(_fd);
+        
+        _fd = -1;
+    }
+    
+    bool isOpen() const { return _fd >= 0; }
+    
+    size_t read(void * data, size_t bytes)
+    {
+        size_t done = 0;
+        while(done < bytes)
+        {
+            const ssize_t result = ::read(_fd, static_cast<char*>(data) + done, bytes - done);
+            if(result < 0 && errno == EINTR)
+                continue;
+            if(result <= 0)
+                break;
+            done += static_cast<size_t>(result);
+        }
+        return done;
+    }
+    
+    size_t write(const void * data, size_t bytes)
+    {
+        size_t done = 0;
+        while(done < bytes)
+        {
+            const ssize_t result = ::write(_fd, static_cast<const char*>(data) + done, bytes - done);
+            if(result < 0 && errno == EINTR)
+                continue;
+            if(result <= 0)
+                break;
+            done += static_cast<size_t>(result);
+        }
+        return done;
+    }
+    
+    // pread/pwrite leave the file position alone, so any number of threads can share the descriptor
+    size_t readAt(uint64_t offset, void * data, size_t bytes)
+    {
+        size_t done = 0;
+        while(done < bytes)
+        {
+            const ssize_t result = ::pread(_fd, static_cast<char*>(data) + done, bytes - done, static_cast<off_t>(offset + done));
+            if(result < 0 && errno == EINTR)
+                continue;
+            if(result <= 0)
+                break;
+            done += static_cast<size_t>(result);
+        }
+        return done;
+    }
+    
+    size_t writeAt(uint64_t offset, const void * data, size_t bytes)
+    {
+        size_t done = 0;
+        while(done < bytes)
+        {
+            const ssize_t result = ::pwrite(_fd, static_cast<const char*>(data) + done, bytes - done, static_cast<off_t>(offset + done));
+            if(result < 0 && errno == EINTR)
+                continue;
+            if(result <= 0)
+                break;
+            done += static_cast<size_t>(result);
+        }
+        return done;
+    }
+    
+    int64_t size() const
+    {
+        struct stat info;
+        if(fstat(_fd, &info) != 0)
+            return -1;
+        
+        return static_cast<int64_t>(info.st_size);
+    }
+    
+    int64_t tell() const { return static_cast<int64_t>(::lseek(_fd, 0, SEEK_CUR)); }
+    
+    int64_t seek(int64_t offset, int whence)
+    {
+        const int posixWhence = whence == RW_SEEK_CUR ? SEEK_CUR : (whence == RW_SEEK_END ? SEEK_END : SEEK_SET);
+        return static_cast<int64_t>(::lseek(_fd, static_cast<off_t>(offset), posixWhence));
+    }
+    
+    void advise(FileAccessHint hint, uint64_t offset, uint64_t length)
+    {
+#if defined(POSIX_FADV_NORMAL)
+        int advice = POSIX_FADV_NORMAL;
+        switch(hint)
+        {
+            case FileAccessHint::SEQUENTIAL: advice = POSIX_FADV_SEQUENTIAL; break;
+            case FileAccessHint::RANDOM: advice = POSIX_FADV_RANDOM; break;
+            case FileAccessHint::WILL_NEED: advice = POSIX_FADV_WILLNEED; break;
+            case FileAccessHint::DONT_NEED: advice = POSIX_FADV_DONTNEED; break;
+            default: break;
+        }
+        posix_fadvise(_fd, static_cast<off_t>(offset), static_cast<off_t>(length), advice);
+#else
+        (void)hint;
+        (void)offset;
+        (void)length;
+#endif
+    }
+    
+    // follows SDL_GetPrefPath on Unix: $XDG_DATA_HOME/organisation/app/, created if missing
+    static std::string prefPath(const std::string & organisation, const std::string & app)
+    {
+        std::string path;
+        const char * dataHome = getenv("XDG_DATA_HOME");
+        const char * home = getenv("HOME");
+        if(dataHome != nullptr && dataHome[0] != 0)
+            path = dataHome;
+        else if(home != nullptr)
+            path = std::string(home) + "/.local/share";
+        else
+            return std::string();
+        
+        path += "/" + organisation;
+        mkdir(path.c_str(), 0700);
+        path += "/" + app;
+        mkdir(path.c_str(), 0700);
+        return path + "/";
+    }
+    
+private:
+    int _fd;
+};
+#endif
+
+#if defined(SDL_FILESTREAM_POSIX)
+typedef PosixFileBackend DefaultFileBackend;
+#else
+typedef SDL_RWopsFileBackend DefaultFileBackend;
+#endif
+
+template<typename Backend>
+class BasicFileStream
 {
 public:
     enum class OpenFlags
@@ -47,32 +485,46 @@ public:
         READ_ONLY = 1 << 1,
         BINARY = 1 << 2,
         CONCATENATE = 1 << 3,
+        BUFFERED = 1 << 4, // coalesce writes in a user-space buffer of DefaultWriteBufferSize bytes
     };
     
+    static const size_t DefaultWriteBufferSize = 256 * 1024;
     
-    SDL_FileStream(const std::string & fullpath, unsigned int flags)
-    :_ops(nullptr)
-    ,_filepath(fullpath)
+    // one part of a gather write
+    struct Buffer
+    {
+        const void * data;
+        size_t size;
+    };
+    
+    BasicFileStream(const std::string & fullpath, unsigned int flags)
+    :_filepath(fullpath)
+    ,_writeBufferSize(0)
     {
+        if(FileStreamStats::enabledByDefault().load(std::memory_order_relaxed))
+            enableStats();
         open(flags);
     }
     
-    ~SDL_FileStream()
+    ~BasicFileStream()
     {
         close();
     }
     
+    BasicFileStream(const BasicFileStream &) = delete;
+    BasicFileStream & operator = (const BasicFileStream &) = delete;
+    
     void close()
     {
-        if(_ops != nullptr)
-            SDL_RWclose(_ops);
-        
-        _ops = nullptr;
+        flush();
+        // whatever could not be written has nowhere left to go
+        _writeBuffer.clear();
+        _backend.close();
     }
     
     bool isOpen() const
     {
-        return _ops != nullptr;
+        return _backend.isOpen();
     }
     
     bool open(unsigned int flags)
@@ -81,83 +533,248 @@ public:
             return false;
         
         const std::string sFlags = unMaskFlags(flags);
-        _ops = SDL_RWFromFile(_filepath.c_str(), sFlags.c_str());
+        _backend.open(_filepath, sFlags);
+        
+        if(flags & static_cast<unsigned int>(OpenFlags::BUFFERED))
+            setWriteBufferSize(DefaultWriteBufferSize);
         
         return isOpen();
     }
     
-    unsigned int bytesLeft()
+    // A size of 0 disables buffering. Pending data is flushed before the buffer is resized;
+    // whatever could not be flushed is kept for the next flush.
+    void setWriteBufferSize(size_t bytes)
+    {
+        flush();
+        _writeBufferSize = bytes;
+        std::vector<unsigned char> buffer;
+        buffer.reserve(std::max(bytes, _writeBuffer.size()));
+        buffer.insert(buffer.end(), _writeBuffer.begin(), _writeBuffer.end());
+        _writeBuffer.swap(buffer);
+    }
+    
+    size_t writeBufferSize() const { return _writeBufferSize; }
+    
+    // Records every read and write that reaches the backend, for this stream and in FileStreamStats::global().
+    void enableStats(bool enabled = true)
+    {
+        if(!enabled)
+            _stats.reset();
+        else if(!_stats)
+            _stats.reset(new FileStreamStats());
+    }
+    
+    // nullptr unless statistics are enabled
+    const FileStreamStats * stats() const { return _stats.get(); }
+    
+    // writes any buffered data to the file
+    bool flush()
+    {
+        if(_writeBuffer.empty())
+            return true;
+        
+        // on a short write the rest stays buffered, as write() has already accepted it
+        const size_t pending = _writeBuffer.size();
+        const size_t written = isOpen() ? backendWrite(_writeBuffer.data(), pending) : 0;
+        _writeBuffer.erase(_writeBuffer.begin(), _writeBuffer.begin() + written);
+        return written == pending;
+    }
+    
+    uint64_t bytesLeft()
     {
         if(!isOpen())
             return 0;
         
-        return static_cast<unsigned int>(SDL_RWsize(_ops) - SDL_RWtell(_ops));
+        flush();
+        const int64_t remaining = _backend.size() - _backend.tell();
+        return remaining > 0 ? static_cast<uint64_t>(remaining) : 0;
     }
     
-    unsigned int read(unsigned int bytes, void * data)
+    int64_t tell()
     {
         if(!isOpen())
+            return -1;
+        
+        return _backend.tell() + static_cast<int64_t>(_writeBuffer.size());
+    }
+    
+    // returns the new offset from the start of the file, or -1 on failure
+    int64_t seek(int64_t offset, int whence = RW_SEEK_SET)
+    {
+        // buffered bytes that could not be written belong at the current position, so don't move
+        if(!isOpen() || !flush())
+            return -1;
+        
+        return _backend.seek(offset, whence);
+    }
+    
+    // returns the number of bytes actually read
+    size_t read(size_t bytes, void * data)
+    {
+        if(!isOpen() || bytes == 0 || !flush())
+            return 0;
+        
+        return backendRead(data, bytes);
+    }
+    
+    // Reads at an absolute offset without moving the file position. With the POSIX
+    // backend several threads may call this at once on the same stream.
+    size_t readAt(uint64_t offset, size_t bytes, void * data)
+    {
+        if(!isOpen() || bytes == 0)
+            return 0;
+        
+        flush();
+        if(!_stats)
+            return _backend.readAt(offset, data, bytes);
+        
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        const size_t bytesRead = _backend.readAt(offset, data, bytes);
+        _stats->record(FileStreamStats::READ, bytesRead, start);
+        return bytesRead;
+    }
+    
+    size_t writeAt(uint64_t offset, size_t dataSize, const void * data)
+    {
+        if(!isOpen() || dataSize == 0)
             return 0;
         
-		size_t amountRead = SDL_RWread(_ops, data, bytes, 1);
-        return static_cast<unsigned int>(amountRead);
+        flush();
+        if(!_stats)
+            return _backend.writeAt(offset, data, dataSize);
+        
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        const size_t bytesWritten = _backend.writeAt(offset, data, dataSize);
+        _stats->record(FileStreamStats::WRITE, bytesWritten, start);
+        return bytesWritten;
+    }
+    
+    // Tells the OS how the file is about to be read. A length of 0 means up to the end of the file.
+    // Ignored by backends that have no such facility.
+    void advise(FileAccessHint hint, uint64_t offset = 0, uint64_t length = 0)
+    {
+        if(isOpen())
+            _backend.advise(hint, offset, length);
     }
     
     template<typename T>
-    unsigned int read(unsigned int itemCount, std::vector<T> & val)
+    size_t read(size_t itemCount, std::vector<T> & val)
     {
         if(itemCount == 0)
             return 0;
 
-        const unsigned int numBytesToRead = sizeof(T) * itemCount;
-        const unsigned int indexToReadFrom = (unsigned int)val.size();
+        const size_t numBytesToRead = sizeof(T) * itemCount;
+        const size_t indexToReadFrom = val.size();
         val.resize(val.size() + itemCount);
-        return read(numBytesToRead, &val[indexToReadFrom]);
+        const size_t bytesRead = read(numBytesToRead, &val[indexToReadFrom]);
+        val.resize(indexToReadFrom + bytesRead / sizeof(T));
+        return bytesRead;
     }
     
     template<typename T>
-    unsigned int read(std::vector<T> & val)
+    size_t read(std::vector<T> & val)
     {
-        const unsigned int numBytesToRead = bytesLeft();
-        const unsigned int itemsToRead = numBytesToRead / sizeof(T);
+        const size_t numBytesToRead = static_cast<size_t>(bytesLeft());
+        const size_t itemsToRead = numBytesToRead / sizeof(T);
         return read(itemsToRead, val);
     }
     
-    unsigned int read(std::string & val)
+    size_t read(std::string & val)
     {
-        const unsigned int numBytesToRead = bytesLeft();
-        const unsigned int indexToReadFrom = (unsigned int)val.size();
+        const size_t numBytesToRead = static_cast<size_t>(bytesLeft());
+        if(numBytesToRead == 0)
+            return 0;
+        
+        const size_t indexToReadFrom = val.size();
         val.resize(val.size() + numBytesToRead);
-        return read(numBytesToRead, &val[indexToReadFrom]);
+        const size_t bytesRead = read(numBytesToRead, &val[indexToReadFrom]);
+        val.resize(indexToReadFrom + bytesRead);
+        return bytesRead;
     }
 
-	unsigned int write(unsigned int dataSize, const void * data)
+	// returns the number of bytes actually written
+	size_t write(size_t dataSize, const void * data)
+	{
+		if (!isOpen() || dataSize == 0)
+			return 0;
+
+		if (_writeBufferSize == 0)
+			return backendWrite(data, dataSize);
+
+		if (_writeBuffer.size() + dataSize > _writeBufferSize && !flush())
+			return 0;
+
+		// too big to be worth copying, hand it straight to the file
+		if (dataSize >= _writeBufferSize)
+			return backendWrite(data, dataSize);
+
+		const unsigned char * bytes = static_cast<const unsigned char*>(data);
+		_writeBuffer.insert(_writeBuffer.end(), bytes, bytes + dataSize);
+		return dataSize;
+	}
+
+	// Writes several buffers in one go. Small buffers are coalesced into a single
+	// file write even when the stream is not in buffered mode.
+	size_t write(const Buffer * buffers, size_t bufferCount)
 	{
 		if (!isOpen())
 			return 0;
 
-		size_t amountWritten = SDL_RWwrite(_ops, data, dataSize, 1);
-		return static_cast<unsigned int>(amountWritten);
+		if (_writeBufferSize > 0)
+		{
+			size_t written = 0;
+			for (size_t i = 0; i < bufferCount; i++)
+				written += write(buffers[i].size, buffers[i].data);
+			return written;
+		}
+
+		size_t total = 0;
+		for (size_t i = 0; i < bufferCount; i++)
+			total += buffers[i].size;
+
+		if (total > DefaultWriteBufferSize)
+		{
+			size_t written = 0;
+			for (size_t i = 0; i < bufferCount; i++)
+				written += write(buffers[i].size, buffers[i].data);
+			return written;
+		}
+
+		_writeBuffer.reserve(total);
+		for (size_t i = 0; i < bufferCount; i++)
+		{
+			const unsigned char * bytes = static_cast<const unsigned char*>(buffers[i].data);
+			_writeBuffer.insert(_writeBuffer.end(), bytes, bytes + buffers[i].size);
+		}
+		if (flush())
+			return total;
+
+		// unbuffered streams only borrow the buffer, so report what got through instead
+		const size_t unwritten = _writeBuffer.size();
+		_writeBuffer.clear();
+		return total - unwritten;
 	}
 
 	template<typename T>
-	unsigned int write(unsigned int numItems, const T * data)
+	size_t write(size_t numItems, const T * data)
 	{
 		return write(numItems * sizeof(T), static_cast<const void*>(data));
 	}
 
-	unsigned int write(const std::string & val)
+	size_t write(const std::string & val)
 	{
-		// assumes string is null terminated
-		return write(static_cast<unsigned int>(val.length() + 1), static_cast<const void*>(val.c_str()));
+		return write(val.length(), static_cast<const void*>(val.data()));
 	}
 
-    unsigned int size() const
+    uint64_t size() const
     {
         if(!isOpen())
             return 0;
         
-        return static_cast<unsigned int>(SDL_RWsize(_ops));
+        const int64_t fileSize = _backend.size();
+        const int64_t bufferedEnd = _backend.tell() + static_cast<int64_t>(_writeBuffer.size());
+        const int64_t totalSize = std::max(fileSize, bufferedEnd);
+        return totalSize > 0 ? static_cast<uint64_t>(totalSize) : 0;
     }
     
     bool exists() const
@@ -165,17 +782,14 @@ public:
         if(isOpen())
             return true;
         
-        SDL_FileStream file(_filepath, static_cast<unsigned int>(OpenFlags::READ_ONLY));
+        BasicFileStream file(_filepath, static_cast<unsigned int>(OpenFlags::READ_ONLY));
         const bool fileExists = file.isOpen();
         return fileExists;
     }
     
     static std::string userDataDirectory(const std::string & app)
     {
-        char * path = SDL_GetPrefPath("kotoristudios", app.c_str());
-        std::string rVal(path);
-        SDL_free(path);
-        return rVal;
+        return Backend::prefPath("kotoristudios", app);
     }
     
     static bool deleteFile(const std::string & fullpath)
@@ -196,7 +810,7 @@ public:
     static std::vector<T> readFile(const std::string fullFilePath, unsigned int fileFlags)
     {
         std::vector<T> data;
-        SDL_FileStream stream(fullFilePath, (unsigned int)SDL_FileStream::OpenFlags::READ_ONLY | (unsigned int)SDL_FileStream::OpenFlags::BINARY);
+        BasicFileStream stream(fullFilePath, (unsigned int)OpenFlags::READ_ONLY | (unsigned int)OpenFlags::BINARY);
         if (stream.isOpen())
         {
             stream.read(data);
@@ -221,8 +835,33 @@ public:
     }
     */
 private:
-    SDL_RWops * _ops;
+    Backend _backend;
     std::string _filepath;
+    std::vector<unsigned char> _writeBuffer;
+    size_t _writeBufferSize;
+    std::unique_ptr<FileStreamStats> _stats;
+    
+    size_t backendRead(void * data, size_t bytes)
+    {
+        if(!_stats)
+            return _backend.read(data, bytes);
+        
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        const size_t bytesRead = _backend.read(data, bytes);
+        _stats->record(FileStreamStats::READ, bytesRead, start);
+        return bytesRead;
+    }
+    
+    size_t backendWrite(const void * data, size_t bytes)
+    {
+        if(!_stats)
+            return _backend.write(data, bytes);
+        
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        const size_t bytesWritten = _backend.write(data, bytes);
+        _stats->record(FileStreamStats::WRITE, bytesWritten, start);
+        return bytesWritten;
+    }
     
     const std::string unMaskFlags(unsigned int flags)
     {
@@ -243,4 +882,152 @@ private:
     
 };
 
+typedef BasicFileStream<DefaultFileBackend> SDL_FileStream;
+
+// Reads a stream in fixed-size chunks. With read-ahead enabled the next chunk is
+// read on a background thread while the caller processes the current one, and the
+// caller's buffer is swapped in as the next read target, so memory use stays at three
+// chunks (the caller's, the one waiting to be handed over and the one being read)
+// regardless of file size. The stream must not be used by anyone else while
+// a reader is attached to it.
+class SDL_FileChunkReader
+{
+public:
+    SDL_FileChunkReader(SDL_FileStream & stream, size_t chunkSize = 1 << 20, bool readAhead = true)
+    :_stream(stream)
+    ,_chunkSize(chunkSize > 0 ? chunkSize : 1)
+    ,_offset(0)
+    ,_nextOffset(0)
+    ,_readAhead(readAhead)
+    ,_finished(false)
+    ,_requested(false)
+    ,_ready(false)
+    ,_stop(false)
+    {
+        const int64_t position = _stream.tell();
+        _nextOffset = position > 0 ? static_cast<uint64_t>(position) : 0;
+        _stream.advise(FileAccessHint::SEQUENTIAL);
+        
+        if(_readAhead)
+        {
+            _requested = true;
+            _worker = std::thread(&SDL_FileChunkReader::readAheadLoop, this);
+        }
+    }
+    
+    ~SDL_FileChunkReader()
+    {
+        if(_worker.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _stop = true;
+            }
+            _condition.notify_all();
+            _worker.join();
+        }
+    }
+    
+    SDL_FileChunkReader(const SDL_FileChunkReader &) = delete;
+    SDL_FileChunkReader & operator = (const SDL_FileChunkReader &) = delete;
+    
+    // Fills chunk with the next part of the stream (at most chunkSize bytes).
+    // Returns false once the end of the stream has been reached.
+    bool next(std::vector<unsigned char> & chunk)
+    {
+        _offset = _nextOffset;
+        // the read-ahead thread is idle once it has delivered the end, so don't wait on it again
+        if(_finished)
+        {
+            chunk.clear();
+            return false;
+        }
+        
+        if(!_readAhead)
+        {
+            chunk.resize(_chunkSize);
+            chunk.resize(_stream.read(_chunkSize, chunk.data()));
+        }
+        else
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _condition.wait(lock, [this]() { return _ready; });
+            chunk.swap(_pending);
+            _ready = false;
+            if(!chunk.empty())
+            {
+                _requested = true;
+                lock.unlock();
+                _condition.notify_all();
+            }
+        }
+        
+        _nextOffset += chunk.size();
+        _finished = chunk.empty();
+        return !_finished;
+    }
+    
+    // offset in the stream of the chunk last returned by next()
+    uint64_t offset() const { return _offset; }
+    size_t chunkSize() const { return _chunkSize; }
+    
+    // Streams the whole file through callback one chunk at a time. Returns the number of bytes read.
+    static uint64_t forEachChunk(const std::string & fullFilePath, size_t chunkSize, const std::function<void(const unsigned char * data, size_t bytes)> & callback)
+    {
+        SDL_FileStream stream(fullFilePath, (unsigned int)SDL_FileStream::OpenFlags::READ_ONLY | (unsigned int)SDL_FileStream::OpenFlags::BINARY);
+        if(!stream.isOpen())
+            return 0;
+        
+        uint64_t total = 0;
+        std::vector<unsigned char> chunk;
+        SDL_FileChunkReader reader(stream, chunkSize);
+        while(reader.next(chunk))
+        {
+            callback(chunk.data(), chunk.size());
+            total += chunk.size();
+        }
+        return total;
+    }
+    
+private:
+    SDL_FileStream & _stream;
+    const size_t _chunkSize;
+    uint64_t _offset;
+    uint64_t _nextOffset;
+    const bool _readAhead;
+    bool _finished;
+    
+    std::thread _worker;
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::vector<unsigned char> _pending;
+    bool _requested;
+    bool _ready;
+    bool _stop;
+    
+    void readAheadLoop()
+    {
+        std::vector<unsigned char> buffer;
+        std::unique_lock<std::mutex> lock(_mutex);
+        for(;;)
+        {
+            _condition.wait(lock, [this]() { return _requested || _stop; });
+            if(_stop)
+                return;
+            
+            _requested = false;
+            buffer.swap(_pending);
+            lock.unlock();
+            
+            buffer.resize(_chunkSize);
+            buffer.resize(_stream.read(_chunkSize, buffer.data()));
+            
+            lock.lock();
+            _pending.swap(buffer);
+            _ready = true;
+            _condition.notify_all();
+        }
+    }
+};
+
 #endif
@@ -0,0 +1,416 @@
+#ifndef _SDL_PACK_FILE_H_
+#define _SDL_PACK_FILE_H_
+
+/*
+ LICENSE - this file is public domain
+
+ This is free and unencumbered software released into the public domain.
+
+ Anyone is free to copy, modify, publish, use, compile, sell, or
+ distribute this software, either in source code form or as a compiled
+ binary, for any purpose, commercial or non-commercial, and by any
+ means.
+
+ In jurisdictions that recognize copyright laws, the author or authors
+ of this software dedicate any and all copyright interest in the
+ software to the public domain. We make this dedication for the benefit
+ of the public at large and to the detriment of our heirs and
+ successors. We intend this dedication to be an overt act of
+ relinquishment in perpetuity of all present and future rights to this
+ software under copyright law.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+ For more information, please refer to <http://unlicense.org/>
+
+ */
+
+/*
+ Pack file layout (native byte order of the host that wrote it):
+
+   header   : magic "SPAK", version, entry count, blob alignment, index offset, index size
+   blobs    : entry data, each starting on a multiple of the alignment
+   index    : entry count x { name hash, offset, size, name offset, name length }
+   names    : all entry names, back to back, not null terminated
+
+ The reader maps the whole pack (or loads it in one read where mmap is not available)
+ and hands out pointers straight into it, so nothing is byte swapped. A pack written on a
+ host of the other byte order fails the version check and is rejected.
+ */
+
+#include "SDL_FileStream.h"
+
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SDL_PACK_FILE_MMAP 1
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+class SDL_PackFileFormat
+{
+public:
+    static const uint32_t Version = 1;
+
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t entryCount;
+        uint32_t alignment;
+        uint64_t indexOffset;
+        uint64_t indexSize;
+    };
+
+    struct Entry
+    {
+        uint64_t hash;
+        uint64_t offset;
+        uint64_t size;
+        uint32_t nameOffset;
+        uint32_t nameLength;
+    };
+
+    // FNV-1a
+    static uint64_t hash(const char * name, size_t length)
+    {
+        uint64_t h = 14695981039346656037ULL;
+        for(size_t i=0 ; i < length ; i++)
+        {
+            h ^= static_cast<unsigned char>(name[i]);
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+
+    static bool isValidHeader(const Header & header)
+    {
+        return memcmp(header.magic, "SPAK", 4) == 0 && header.version == Version && header.alignment > 0;
+    }
+};
+
+class SDL_PackFileWriter
+{
+public:
+    // alignment is the byte boundary every entry starts on
+    SDL_PackFileWriter(const std::string & fullpath, unsigned int alignment = 16)
+    :_stream(fullpath, static_cast<unsigned int>(SDL_FileStream::OpenFlags::READ_WRITE) | static_cast<unsigned int>(SDL_FileStream::OpenFlags::BINARY) | static_cast<unsigned int>(SDL_FileStream::OpenFlags::BUFFERED))
+    ,_alignment(alignment > 0 ? alignment : 1)
+    ,_offset(0)
+    ,_finished(false)
+    ,_failed(false)
+    {
+        SDL_PackFileFormat::Header header;
+        memset(&header, 0, sizeof(header));
+        _offset = _stream.write(sizeof(header), static_cast<const void*>(&header));
+        _failed = _offset != sizeof(header);
+    }
+
+    ~SDL_PackFileWriter()
+    {
+        finish();
+    }
+
+    // false once finished, or after a write failed: offsets past a short write would be wrong
+    bool isOpen() const
+    {
+        return _stream.isOpen() && !_finished && !_failed;
+    }
+
+    bool add(const std::string & name, const void * data, size_t size)
+    {
+        if(!isOpen() || _names.count(name) != 0)
+            return false;
+
+        pad(_alignment);
+        if(_failed)
+            return false;
+
+        SDL_PackFileFormat::Entry entry;
+        entry.hash = SDL_PackFileFormat::hash(name.data(), name.length());
+        entry.offset = _offset;
+        entry.size = size;
+        entry.nameOffset = static_cast<uint32_t>(_nameTable.size());
+        entry.nameLength = static_cast<uint32_t>(name.length());
+
+        const size_t written = _stream.write(size, data);
+        _offset += written;
+        if(written != size)
+        {
+            _failed = true;
+            return false;
+        }
+
+        _nameTable += name;
+        _names.insert(name);
+        _entries.push_back(entry);
+        return true;
+    }
+
+    bool addFile(const std::string & name, const std::string & sourcePath)
+    {
+        SDL_FileStream source(sourcePath, static_cast<unsigned int>(SDL_FileStream::OpenFlags::READ_ONLY) | static_cast<unsigned int>(SDL_FileStream::OpenFlags::BINARY));
+        if(!source.isOpen())
+            return false;
+
+        std::vector<unsigned char> data;
+        source.read(data);
+        return add(name, data.data(), data.size());
+    }
+
+    // writes the index and header. Called by the destructor if not done explicitly. After a
+    // failed write the header is left zeroed, so the incomplete pack is never opened.
+    bool finish()
+    {
+        if(!_stream.isOpen() || _finished)
+            return false;
+
+        // the index is read in place, so keep it aligned for its 64-bit fields
+        pad(8);
+        _finished = true;
+        if(_failed)
+        {
+            _stream.close();
+            return false;
+        }
+
+        SDL_PackFileFormat::Header header;
+        memcpy(header.magic, "SPAK", 4);
+        header.version = SDL_PackFileFormat::Version;
+        header.entryCount = static_cast<uint32_t>(_entries.size());
+        header.alignment = _alignment;
+        header.indexOffset = _offset;
+        header.indexSize = _entries.size() * sizeof(SDL_PackFileFormat::Entry) + _nameTable.size();
+
+        const size_t entriesSize = _entries.size() * sizeof(SDL_PackFileFormat::Entry);
+        // the header goes in last and only if everything before it made it to the file
+        bool success = _stream.write(entriesSize, static_cast<const void*>(_entries.data())) == entriesSize;
+        success = success && _stream.write(_nameTable.size(), static_cast<const void*>(_nameTable.data())) == _nameTable.size();
+        success = success && _stream.seek(0) == 0;
+        success = success && _stream.write(sizeof(header), static_cast<const void*>(&header)) == sizeof(header);
+        success = success && _stream.flush();
+        _stream.close();
+        return success;
+    }
+
+private:
+    SDL_FileStream _stream;
+    const unsigned int _alignment;
+    uint64_t _offset;
+    bool _finished;
+    bool _failed;
+    std::vector<SDL_PackFileFormat::Entry> _entries;
+    std::string _nameTable;
+    std::unordered_set<std::string> _names;
+
+    void pad(unsigned int alignment)
+    {
+        static const unsigned char zeros[64] = {};
+        uint64_t padding = (alignment - (_offset % alignment)) % alignment;
+        while(padding > 0)
+        {
+            const size_t bytes = padding < sizeof(zeros) ? static_cast<size_t>(padding) : sizeof(zeros);
+            const size_t written = _stream.write(bytes, static_cast<const void*>(zeros));
+            _offset += written;
+            if(written != bytes)
+            {
+                _failed = true;
+                return;
+            }
+            padding -= bytes;
+        }
+    }
+};
+
+class SDL_PackFile
+{
+public:
+    struct View
+    {
+        const unsigned char * data;
+        uint64_t size;
+
+        bool isValid() const { return data != nullptr; }
+    };
+
+    SDL_PackFile(const std::string & fullpath)
+    :_data(nullptr)
+    ,_size(0)
+    ,_mapped(false)
+    ,_entries(nullptr)
+    ,_names(nullptr)
+    ,_entryCount(0)
+    ,_slotMask(0)
+    {
+        if(!load(fullpath) || !parse())
+            close();
+    }
+
+    ~SDL_PackFile()
+    {
+        close();
+    }
+
+    SDL_PackFile(const SDL_PackFile &) = delete;
+    SDL_PackFile & operator = (const SDL_PackFile &) = delete;
+
+    bool isOpen() const { return _data != nullptr; }
+    unsigned int entryCount() const { return _entryCount; }
+
+    std::string name(unsigned int index) const
+    {
+        return std::string(_names + _entries[index].nameOffset, _entries[index].nameLength);
+    }
+
+    View get(unsigned int index) const
+    {
+        View view = { _data + _entries[index].offset, _entries[index].size };
+        return view;
+    }
+
+    // returns a view with data == nullptr if the pack has no entry called name
+    View get(const std::string & name) const
+    {
+        View view = { nullptr, 0 };
+        if(!isOpen())
+            return view;
+
+        const uint64_t h = SDL_PackFileFormat::hash(name.data(), name.length());
+        for(uint64_t slot = h & _slotMask ; _slots[slot] != 0 ; slot = (slot + 1) & _slotMask)
+        {
+            const SDL_PackFileFormat::Entry & entry = _entries[_slots[slot] - 1];
+            if(entry.hash == h && entry.nameLength == name.length() && memcmp(_names + entry.nameOffset, name.data(), name.length()) == 0)
+            {
+                view.data = _data + entry.offset;
+                view.size = entry.size;
+                break;
+            }
+        }
+        return view;
+    }
+
+    void close()
+    {
+#if defined(SDL_PACK_FILE_MMAP)
+        if(_mapped && _data != nullptr)
+            munmap(const_cast<unsigned char*>(_data), static_cast<size_t>(_size));
+#endif
+        _data = nullptr;
+        _size = 0;
+        _mapped = false;
+        _entries = nullptr;
+        _names = nullptr;
+        _entryCount = 0;
+        _slots.clear();
+        _buffer.clear();
+    }
+
+private:
+    const unsigned char * _data;
+    uint64_t _size;
+    bool _mapped;
+    std::vector<unsigned char> _buffer;
+
+    const SDL_PackFileFormat::Entry * _entries;
+    const char * _names;
+    unsigned int _entryCount;
+
+    // open addressing table of entry index + 1, 0 marks an empty slot
+    std::vector<unsigned int> _slots;
+    uint64_t _slotMask;
+
+    bool load(const std::string & fullpath)
+    {
+#if defined(SDL_PACK_FILE_MMAP)
+        const int fd = ::open(fullpath.c_str(), O_RDONLY);
+        if(fd < 0)
+            return false;
+
+        struct stat info;
+        if(fstat(fd, &info) != 0 || info.st_size <= 0)
+        {
+            ::close(fd);
+            return false;
+        }
+
+        void * mapping = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if(mapping == MAP_FAILED)
+            return false;
+
+        _data = static_cast<const unsigned char*>(mapping);
+        _size = static_cast<uint64_t>(info.st_size);
+        _mapped = true;
+        return true;
+#else
+        SDL_FileStream stream(fullpath, static_cast<unsigned int>(SDL_FileStream::OpenFlags::READ_ONLY) | static_cast<unsigned int>(SDL_FileStream::OpenFlags::BINARY));
+        if(!stream.isOpen())
+            return false;
+
+        stream.read(_buffer);
+        if(_buffer.empty())
+            return false;
+
+        _data = _buffer.data();
+        _size = _buffer.size();
+        return true;
+#endif
+    }
+
+    bool parse()
+    {
+        if(_size < sizeof(SDL_PackFileFormat::Header))
+            return false;
+
+        SDL_PackFileFormat::Header header;
+        memcpy(&header, _data, sizeof(header));
+        if(!SDL_PackFileFormat::isValidHeader(header))
+            return false;
+
+        const uint64_t entriesSize = uint64_t(header.entryCount) * sizeof(SDL_PackFileFormat::Entry);
+        if(header.indexOffset > _size || header.indexSize > _size - header.indexOffset || entriesSize > header.indexSize)
+            return false;
+
+        _entries = reinterpret_cast<const SDL_PackFileFormat::Entry*>(_data + header.indexOffset);
+        _names = reinterpret_cast<const char*>(_data + header.indexOffset + entriesSize);
+        _entryCount = header.entryCount;
+
+        const uint64_t namesSize = header.indexSize - entriesSize;
+        for(unsigned int i=0 ; i < _entryCount ; i++)
+        {
+            const SDL_PackFileFormat::Entry & entry = _entries[i];
+            if(entry.offset > header.indexOffset || entry.size > header.indexOffset - entry.offset || uint64_t(entry.nameOffset) + entry.nameLength > namesSize)
+                return false;
+        }
+
+        uint64_t slotCount = 16;
+        while(slotCount < uint64_t(_entryCount) * 2)
+            slotCount *= 2;
+
+        _slots.assign(static_cast<size_t>(slotCount), 0);
+        _slotMask = slotCount - 1;
+        for(unsigned int i=0 ; i < _entryCount ; i++)
+        {
+            uint64_t slot = _entries[i].hash & _slotMask;
+            while(_slots[slot] != 0)
+                slot = (slot + 1) & _slotMask;
+            _slots[slot] = i + 1;
+        }
+        return true;
+    }
+};
+
+#endif
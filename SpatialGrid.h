@@ -0,0 +1,348 @@
+#ifndef _SPATIAL_GRID_H_
+#define _SPATIAL_GRID_H_
+
+/*
+LICENSE - this file is public domain
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "AABB.h"
+
+/*
+ Cell list for fixed radius neighbour queries over points that all move every step, as a
+ rebuild-cheap alternative to KDTree. build() is a counting sort of the points by cell, O(N)
+ and split over threads; afterwards the points of a cell are contiguous, and sortedPoints()
+ and sortedIndices() give that order so per-particle data can be kept in it as well.
+
+ Cells are at least cellSize wide, so queries with radius <= cellSize only visit the 3^DIM
+ cells around the centre. When the domain has many more cells than points (sparse points in a
+ large domain) cells are hashed into a table of about as many buckets as points instead.
+
+ Periodic domains wrap in every dimension, with distances measured to the nearest image.
+ Otherwise points outside the domain are kept in the border cells, which only costs speed.
+ */
+template<typename PointClass, unsigned int DIM, typename RadiusType>
+class SpatialGrid
+{
+public:
+	SpatialGrid(const PointClass & min, const PointClass & max, RadiusType cellSize, bool periodic = false)
+		:_periodic(periodic)
+		,_bucketCount(0)
+		,_hashed(false)
+	{
+		for (unsigned int dim = 0; dim < DIM; dim++)
+		{
+			_min[dim] = min[dim];
+			_size[dim] = max[dim] - min[dim];
+			const RadiusType cells = _size[dim] / cellSize;
+			// the cell count is rounded down, so cells tile the domain exactly (which periodic
+			// domains need) and are never narrower than cellSize
+			_cellCount[dim] = std::max(1, int(std::floor(cells)));
+			_inverseCellWidth[dim] = RadiusType(_cellCount[dim]) / _size[dim];
+		}
+	}
+
+	template<long MIN, long MAX>
+	SpatialGrid(const AABB<PointClass, RadiusType, DIM, MIN, MAX> & domain, RadiusType cellSize, bool periodic = false)
+		:SpatialGrid(domain.getMin(), domain.getMax(), cellSize, periodic)
+	{
+	}
+
+	// threads = 0 uses every hardware thread
+	void build(const std::vector<PointClass> & points, unsigned int threads = 0)
+	{
+		build(points.empty() ? nullptr : &points[0], points.size(), threads);
+	}
+
+	void build(const PointClass * points, size_t count, unsigned int threads = 0)
+	{
+		if (threads == 0)
+			threads = std::max(1u, std::thread::hardware_concurrency());
+		threads = (unsigned int)std::min<size_t>(threads, std::max<size_t>(1, count / MinPointsPerThread));
+
+		size_t denseCells = 1;
+		for (unsigned int dim = 0; dim < DIM && denseCells <= MaxDenseCellsPerPoint * std::max<size_t>(count, 1); dim++)
+			denseCells *= size_t(_cellCount[dim]);
+
+		_hashed = denseCells > MaxDenseCellsPerPoint * std::max<size_t>(count, 1);
+		size_t buckets = denseCells;
+		if (_hashed)
+		{
+			buckets = 1;
+			while (buckets < count)
+				buckets <<= 1;
+		}
+
+		if (buckets != _bucketCount)
+		{
+			_bucketCount = buckets;
+			_counts.reset(new std::atomic<uint32_t>[buckets]);
+		}
+		_cellStart.resize(buckets + 1);
+		_bucketOf.resize(count);
+		_sortedPoints.resize(count);
+		_sortedIndices.resize(count);
+
+		// bucket of every point, and how many points each bucket gets
+		parallelFor(buckets, threads, [&](size_t first, size_t last)
+		{
+			for (size_t i = first; i < last; i++)
+				_counts[i].store(0, std::memory_order_relaxed);
+		});
+		parallelFor(count, threads, [&](size_t first, size_t last)
+		{
+			for (size_t i = first; i < last; i++)
+			{
+				int cell[DIM];
+				cellOf(points[i], cell);
+				_bucketOf[i] = uint32_t(bucketOf(cell));
+				_counts[_bucketOf[i]].fetch_add(1, std::memory_order_relaxed);
+			}
+		});
+
+		uint32_t offset = 0;
+		for (size_t bucket = 0; bucket < buckets; bucket++)
+		{
+			_cellStart[bucket] = offset;
+			offset += _counts[bucket].load(std::memory_order_relaxed);
+			_counts[bucket].store(_cellStart[bucket], std::memory_order_relaxed);
+		}
+		_cellStart[buckets] = offset;
+
+		// scatter, then restore the original order inside each bucket so the result does not
+		// depend on how the threads interleaved
+		parallelFor(count, threads, [&](size_t first, size_t last)
+		{
+			for (size_t i = first; i < last; i++)
+				_sortedIndices[_counts[_bucketOf[i]].fetch_add(1, std::memory_order_relaxed)] = uint32_t(i);
+		});
+		parallelFor(buckets, threads, [&](size_t first, size_t last)
+		{
+			for (size_t bucket = first; bucket < last; bucket++)
+			{
+				if (threads > 1 && _cellStart[bucket + 1] - _cellStart[bucket] > 1)
+					std::sort(_sortedIndices.begin() + _cellStart[bucket], _sortedIndices.begin() + _cellStart[bucket + 1]);
+				for (uint32_t i = _cellStart[bucket]; i < _cellStart[bucket + 1]; i++)
+					_sortedPoints[i] = points[_sortedIndices[i]];
+			}
+		});
+	}
+
+	// appends the original index of every point within radius of center, like KDTree::inside()
+	void inside(const PointClass & center, RadiusType radius, std::vector<unsigned int> & indices) const
+	{
+		forEachInside(center, radius, [&](unsigned int sortedIndex, RadiusType)
+		{
+			indices.push_back(_sortedIndices[sortedIndex]);
+		});
+	}
+
+	// calls callback(sortedIndex, squaredDistance) for every point within radius of center
+	template<typename Callback>
+	void forEachInside(const PointClass & center, RadiusType radius, Callback callback) const
+	{
+		if (_sortedPoints.empty())
+			return;
+
+		int cell[DIM];
+		cellOf(center, cell);
+
+		int lower[DIM];
+		int upper[DIM];
+		int neighbour[DIM];
+		for (unsigned int dim = 0; dim < DIM; dim++)
+		{
+			const int reach = int(std::ceil(radius * _inverseCellWidth[dim]));
+			if (_periodic && 2 * reach + 1 >= _cellCount[dim])
+			{
+				lower[dim] = 0;
+				upper[dim] = _cellCount[dim] - 1;
+			}
+			else if (_periodic)
+			{
+				lower[dim] = cell[dim] - reach;
+				upper[dim] = cell[dim] + reach;
+			}
+			else
+			{
+				lower[dim] = std::max(0, cell[dim] - reach);
+				upper[dim] = std::min(_cellCount[dim] - 1, cell[dim] + reach);
+			}
+			neighbour[dim] = lower[dim];
+		}
+
+		// hashed cells can share a bucket, which must then only be scanned once
+		uint32_t visitedInline[64];
+		std::vector<uint32_t> visitedOverflow;
+		size_t visitedCount = 0;
+
+		const RadiusType squaredRadius = radius * radius;
+		for (;;)
+		{
+			int wrapped[DIM];
+			for (unsigned int dim = 0; dim < DIM; dim++)
+				wrapped[dim] = _periodic ? wrap(neighbour[dim], _cellCount[dim]) : neighbour[dim];
+
+			const uint32_t bucket = uint32_t(bucketOf(wrapped));
+			bool scan = true;
+			if (_hashed)
+			{
+				for (size_t i = 0; i < visitedCount && scan; i++)
+					scan = (i < 64 ? visitedInline[i] : visitedOverflow[i - 64]) != bucket;
+				if (scan)
+				{
+					if (visitedCount < 64)
+						visitedInline[visitedCount] = bucket;
+					else
+						visitedOverflow.push_back(bucket);
+					visitedCount++;
+				}
+			}
+
+			if (scan)
+			{
+				for (uint32_t i = _cellStart[bucket]; i < _cellStart[bucket + 1]; i++)
+				{
+					const PointClass & point = _sortedPoints[i];
+					RadiusType squaredDistance = 0;
+					for (unsigned int dim = 0; dim < DIM; dim++)
+					{
+						RadiusType delta = point[dim] - center[dim];
+						if (_periodic)
+							delta -= _size[dim] * std::round(delta / _size[dim]);
+						squaredDistance += delta * delta;
+					}
+					if (squaredDistance <= squaredRadius)
+						callback(i, squaredDistance);
+				}
+			}
+
+			unsigned int dim = 0;
+			for (; dim < DIM; dim++)
+			{
+				if (++neighbour[dim] <= upper[dim])
+					break;
+				neighbour[dim] = lower[dim];
+			}
+			if (dim == DIM)
+				break;
+		}
+	}
+
+	// the points in cell order, and for each its index in the array given to build()
+	const std::vector<PointClass> & sortedPoints() const { return _sortedPoints; }
+	const std::vector<uint32_t> & sortedIndices() const { return _sortedIndices; }
+
+	bool isHashed() const { return _hashed; }
+	size_t bucketCount() const { return _bucketCount; }
+
+private:
+	// above this many cells per point the grid is hashed
+	static const size_t MaxDenseCellsPerPoint = 4;
+	static const size_t MinPointsPerThread = 1 << 15;
+
+	RadiusType _min[DIM];
+	RadiusType _size[DIM];
+	RadiusType _inverseCellWidth[DIM];
+	int _cellCount[DIM];
+	bool _periodic;
+
+	size_t _bucketCount;
+	bool _hashed;
+	std::unique_ptr<std::atomic<uint32_t>[]> _counts;
+	std::vector<uint32_t> _cellStart;
+	std::vector<uint32_t> _bucketOf;
+	std::vector<PointClass> _sortedPoints;
+	std::vector<uint32_t> _sortedIndices;
+
+	static inline int wrap(int value, int count)
+	{
+		const int wrapped = value % count;
+		return wrapped < 0 ? wrapped + count : wrapped;
+	}
+
+	inline void cellOf(const PointClass & point, int * cell) const
+	{
+		for (unsigned int dim = 0; dim < DIM; dim++)
+		{
+			const int index = int(std::floor((point[dim] - _min[dim]) * _inverseCellWidth[dim]));
+			cell[dim] = _periodic ? wrap(index, _cellCount[dim]) : std::min(std::max(index, 0), _cellCount[dim] - 1);
+		}
+	}
+
+	inline size_t bucketOf(const int * cell) const
+	{
+		if (_hashed)
+		{
+			static const uint32_t primes[3] = { 73856093u, 19349663u, 83492791u };
+			uint32_t hash = 0;
+			for (unsigned int dim = 0; dim < DIM; dim++)
+				hash ^= uint32_t(cell[dim]) * primes[dim % 3];
+			// fold the high bits in, the table index only uses the low ones
+			hash ^= hash >> 16;
+			return size_t(hash) & (_bucketCount - 1);
+		}
+
+		size_t index = size_t(cell[DIM - 1]);
+		for (int dim = int(DIM) - 2; dim >= 0; dim--)
+			index = index * size_t(_cellCount[dim]) + size_t(cell[dim]);
+		return index;
+	}
+
+	template<typename Function>
+	static void parallelFor(size_t count, unsigned int threads, Function function)
+	{
+		if (threads <= 1 || count < threads)
+		{
+			function(size_t(0), count);
+			return;
+		}
+
+		std::vector<std::thread> pool;
+		const size_t slice = (count + threads - 1) / threads;
+		for (unsigned int t = 1; t < threads; t++)
+		{
+			const size_t first = std::min(count, t * slice);
+			const size_t last = std::min(count, first + slice);
+			pool.push_back(std::thread(function, first, last));
+		}
+		function(size_t(0), std::min(count, slice));
+		for (size_t i = 0; i < pool.size(); i++)
+			pool[i].join();
+	}
+};
+
+#endif